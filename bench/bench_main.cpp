@@ -0,0 +1,548 @@
+// Benchmarks for the config, store, search and list hot paths.
+//
+// Usage: clip-template-bench [options] [template-count]
+//   --sizes N,N,...   template counts to run (default 100,1000,10000,100000;
+//                     a single template-count argument runs only that)
+//   --iterations N    repetitions of each measurement (default 5)
+//   --filter TEXT     only run benchmarks whose name contains TEXT
+//   --output FILE     write the report to FILE instead of stdout
+//
+// The report is JSON, one entry per benchmark and template count with the
+// timing statistics in milliseconds, so runs can be diffed or compared by
+// scripts. Progress goes to stderr. Widgets use the offscreen platform
+// unless QT_QPA_PLATFORM is set.
+
+#include <QApplication>
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QListView>
+#include <QScrollBar>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QDateTime>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "templatemanager.h"
+#include "configreader.h"
+#include "templatestore.h"
+#include "templatesearch.h"
+#include "fuzzymatcher.h"
+#include "searchworker.h"
+#include "templatelistmodel.h"
+#include "templateitemdelegate.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Words are already in folded form so keys can be built without folding
+const std::vector<std::string> Vocabulary = {
+    "meeting", "notes", "review", "deploy", "release", "incident", "report",
+    "customer", "invoice", "schedule", "summary", "weekly", "status", "request",
+    "approval", "server", "database", "backup", "config", "template",
+    "かいぎ", "ほうこく", "よてい", "しりょう", "かくにん", "おねがい", "ありがとう",
+    "しゅうせい", "たいおう", "れんらく", "せいきゅうしょ", "みつもり"
+};
+
+// What a user types into the search box, one entry per keystroke; '\b'
+// is a backspace
+const std::vector<std::string> SubstringTyping = {
+    "meeting notes", "invoi\b\bvoice", "deploy rel", "かいぎ しりょう", "ほうこくz\b"
+};
+const std::vector<std::string> FuzzyTyping = {
+    "mtg nts", "invc", "dply rls", "かぎしりょ", "qzx\b\b"
+};
+
+std::vector<Template> generateTemplates(size_t count)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> word(0, Vocabulary.size() - 1);
+    std::uniform_int_distribution<int> contentWords(10, 60);
+
+    std::vector<Template> templates;
+    templates.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        Template tmpl;
+        tmpl.name = Vocabulary[word(rng)] + " " + Vocabulary[word(rng)] + " " + std::to_string(i);
+        tmpl.category = Vocabulary[word(rng)];
+        const int words = contentWords(rng);
+        for (int w = 0; w < words; ++w) {
+            tmpl.content += Vocabulary[word(rng)];
+            tmpl.content += (w % 8 == 7) ? '\n' : ' ';
+        }
+        tmpl.shortcut = static_cast<int>(i % 10);
+        tmpl.searchKey = tmpl.name + '\0' + tmpl.category + '\0' + tmpl.content;
+        templates.push_back(std::move(tmpl));
+    }
+    return templates;
+}
+
+size_t linearSearch(const std::vector<Template> &templates, const std::string &query)
+{
+    size_t matches = 0;
+    for (const auto &tmpl : templates) {
+        if (tmpl.searchKey.find(query) != std::string::npos) {
+            ++matches;
+        }
+    }
+    return matches;
+}
+
+// The search box contents after each keystroke of a typing sequence
+std::vector<QString> keystrokes(const std::string &typing)
+{
+    std::vector<QString> texts;
+    QString text;
+    for (const QChar ch : QString::fromStdString(typing)) {
+        if (ch == QLatin1Char('\b')) {
+            text.chop(1);
+        } else {
+            text.append(ch);
+        }
+        texts.push_back(text);
+    }
+    return texts;
+}
+
+class Suite {
+public:
+    Suite(const QString &filter, int iterations)
+        : m_filter(filter)
+        , m_iterations(iterations)
+    {
+    }
+
+    bool enabled(const QString &name) const { return m_filter.isEmpty() || name.contains(m_filter); }
+    bool enabledAny(std::initializer_list<const char *> names) const
+    {
+        return std::any_of(names.begin(), names.end(), [this](const char *name) { return enabled(name); });
+    }
+    int iterations() const { return m_iterations; }
+
+    // Times run() once per iteration
+    void measure(const QString &name, size_t templates, const std::function<void()> &run,
+                 const QJsonObject &extra = QJsonObject())
+    {
+        if (!enabled(name)) {
+            return;
+        }
+        std::vector<double> samples;
+        for (int i = 0; i < m_iterations; ++i) {
+            const auto start = Clock::now();
+            run();
+            samples.push_back(elapsedMs(start));
+        }
+        report(name, templates, samples, extra);
+    }
+
+    void report(const QString &name, size_t templates, std::vector<double> samples,
+                const QJsonObject &extra = QJsonObject())
+    {
+        if (samples.empty()) {
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&samples](double p) {
+            return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))];
+        };
+        double total = 0;
+        for (double sample : samples) {
+            total += sample;
+        }
+
+        QJsonObject result = extra;
+        result["name"] = name;
+        result["templates"] = static_cast<qint64>(templates);
+        result["samples"] = static_cast<qint64>(samples.size());
+        result["mean_ms"] = total / samples.size();
+        result["min_ms"] = samples.front();
+        result["p50_ms"] = percentile(0.50);
+        result["p95_ms"] = percentile(0.95);
+        result["max_ms"] = samples.back();
+        m_results.append(result);
+
+        std::cerr << templates << "\t" << name.toStdString();
+        if (extra.contains("query")) {
+            std::cerr << " \"" << extra["query"].toString().toStdString() << "\"";
+        }
+        if (extra.contains("painting")) {
+            std::cerr << " (" << extra["painting"].toString().toStdString() << ")";
+        }
+        std::cerr << "\t" << result["p50_ms"].toDouble() << " ms" << std::endl;
+    }
+
+    void fail(const std::string &message)
+    {
+        std::cerr << message << std::endl;
+        m_failed = true;
+    }
+
+    bool failed() const { return m_failed; }
+    const QJsonArray &results() const { return m_results; }
+
+private:
+    QString m_filter;
+    int m_iterations;
+    QJsonArray m_results;
+    bool m_failed = false;
+};
+
+void benchConfig(Suite &suite, const std::vector<Template> &templates)
+{
+    if (!suite.enabledAny({"config.write", "config.read", "config.read_streaming"})) {
+        return;
+    }
+    QTemporaryDir dir;
+    const std::string path = dir.filePath("templates.yaml").toStdString();
+    ConfigReader reader;
+
+    suite.measure("config.write", templates.size(), [&]() {
+        reader.writeConfig(path, templates);
+    });
+    if (!QFile::exists(QString::fromStdString(path))) {
+        reader.writeConfig(path, templates); // filtered out, but read needs it
+    }
+
+    size_t read = 0;
+    suite.measure("config.read", templates.size(), [&]() {
+        std::vector<Template> loaded;
+        reader.readConfig(path, loaded);
+        read = loaded.size();
+    });
+    if (suite.enabled("config.read") && read != templates.size()) {
+        suite.fail("config.read returned " + std::to_string(read) + " of " + std::to_string(templates.size()));
+    }
+
+    // Total time, and the time until the first rows could be shown
+    if (suite.enabled("config.read_streaming")) {
+        std::vector<double> total;
+        std::vector<double> firstBatch;
+        for (int i = 0; i < suite.iterations(); ++i) {
+            const auto start = Clock::now();
+            bool first = true;
+            reader.readConfigStreaming(path, 32, [&](std::vector<Template> &) {
+                if (first) {
+                    firstBatch.push_back(elapsedMs(start));
+                    first = false;
+                }
+                return true;
+            });
+            total.push_back(elapsedMs(start));
+        }
+        suite.report("config.read_streaming", templates.size(), total);
+        suite.report("config.read_streaming.first_batch", templates.size(), firstBatch);
+    }
+}
+
+// Building the slots MainWindow searches and shows, against the heap
+// the parsed templates held; leaves store filled for the later benchmarks
+void benchStore(Suite &suite, const std::vector<Template> &templates, TemplateStore &store)
+{
+    std::vector<double> samples;
+    const int iterations = suite.enabled("store.assign") ? suite.iterations() : 1;
+    for (int i = 0; i < iterations; ++i) {
+        std::vector<Template> copy = templates;
+        const auto start = Clock::now();
+        store.assign(std::move(copy));
+        samples.push_back(elapsedMs(start));
+    }
+    if (!suite.enabled("store.assign")) {
+        return;
+    }
+
+    size_t stringBytes = 0;
+    for (const auto &tmpl : templates) {
+        stringBytes += tmpl.name.capacity() + tmpl.content.capacity() + tmpl.category.capacity() +
+                       tmpl.searchKey.capacity();
+    }
+    suite.report("store.assign", templates.size(), samples,
+                 {{"arena_bytes", static_cast<qint64>(store.arenaSize())},
+                  {"string_bytes", static_cast<qint64>(stringBytes)}});
+}
+
+void benchSearch(Suite &suite, const TemplateStore &store, const std::vector<Template> &templates)
+{
+    TemplateSearch search;
+    suite.measure("search.index_build", templates.size(), [&]() {
+        search.setTemplates(store);
+    });
+    if (!suite.enabled("search.index_build")) {
+        search.setTemplates(store);
+    }
+
+    // Cold queries against a linear scan, which doubles as a check
+    const std::vector<std::string> queries = {
+        "me", "mee", "meeting", "meeting notes", "invoice 12345",
+        "ほうこく", "かいぎ しりょう", "zzzz"
+    };
+    std::vector<uint32_t> results;
+    for (const auto &query : queries) {
+        size_t linearMatches = 0;
+        suite.measure("search.linear", templates.size(), [&]() {
+            linearMatches = linearSearch(templates, query);
+        }, {{"query", QString::fromStdString(query)}});
+
+        // Reset the refinement cache so every iteration is a cold query
+        size_t indexedMatches = 0;
+        suite.measure("search.substring.cold", templates.size(), [&]() {
+            search.search(std::string(), results);
+            search.search(query, results);
+            indexedMatches = results.size();
+        }, {{"query", QString::fromStdString(query)}});
+
+        if (suite.enabled("search.linear") && suite.enabled("search.substring.cold") &&
+            linearMatches != indexedMatches) {
+            suite.fail("mismatch for \"" + query + "\": " + std::to_string(linearMatches) + " vs " +
+                       std::to_string(indexedMatches));
+        }
+    }
+
+    // Fuzzy prefilters; also checks that the SIMD and scalar ones agree
+    if (!suite.enabledAny({"fuzzy.prefilter.scalar", "fuzzy.prefilter.simd"})) {
+        return;
+    }
+    FuzzyMatcher simd;
+    FuzzyMatcher scalar;
+    simd.setTemplates(store);
+    scalar.setTemplates(store);
+    scalar.setSimdEnabled(false);
+    for (const auto &query : {"mtgnt", "invc", "dply rls", "かぎしりょ", "qzx"}) {
+        simd.setQuery(query);
+        scalar.setQuery(query);
+        std::vector<uint32_t> simdCandidates;
+        std::vector<uint32_t> scalarCandidates;
+        suite.measure("fuzzy.prefilter.scalar", templates.size(), [&]() {
+            scalar.prefilter(scalarCandidates);
+        }, {{"query", query}});
+        suite.measure("fuzzy.prefilter.simd", templates.size(), [&]() {
+            simd.prefilter(simdCandidates);
+        }, {{"query", query}});
+
+        if (!suite.enabled("fuzzy.prefilter.scalar") || !suite.enabled("fuzzy.prefilter.simd")) {
+            continue;
+        }
+        if (simdCandidates != scalarCandidates) {
+            suite.fail(std::string("prefilter mismatch for \"") + query + "\"");
+        }
+    }
+}
+
+// What MainWindow::filterTemplates() does per keystroke: a query to the
+// search worker, and its results back on the GUI thread
+void benchKeystrokes(Suite &suite, const TemplateStore &templates, TemplateSearch::Mode mode)
+{
+    const bool fuzzy = mode == TemplateSearch::Mode::Fuzzy;
+    const QString name = fuzzy ? "filter.keystroke.fuzzy" : "filter.keystroke.substring";
+    if (!suite.enabled(name)) {
+        return;
+    }
+
+    SearchWorker worker;
+    worker.setTemplates(templates);
+    worker.setMode(mode);
+
+    QEventLoop loop;
+    quint64 waitingFor = 0;
+    size_t matches = 0;
+    QObject::connect(&worker, &SearchWorker::resultsReady, &loop,
+                     [&](quint64 generation, const std::vector<uint32_t> &results) {
+        if (generation == waitingFor) {
+            matches = results.size();
+            loop.quit();
+        }
+    });
+
+    for (const auto &typing : fuzzy ? FuzzyTyping : SubstringTyping) {
+        const std::vector<QString> texts = keystrokes(typing);
+        std::vector<double> samples;
+        for (int i = 0; i < suite.iterations(); ++i) {
+            worker.search(QString()); // start from an empty box
+            for (const QString &text : texts) {
+                const auto start = Clock::now();
+                waitingFor = worker.search(text);
+                loop.exec();
+                samples.push_back(elapsedMs(start));
+            }
+        }
+        QString query = QString::fromStdString(typing);
+        query.replace(QLatin1Char('\b'), QLatin1String("<BS>"));
+        suite.report(name, templates.size(), samples,
+                     {{"query", query}, {"keystrokes", static_cast<int>(texts.size())},
+                      {"matches", static_cast<qint64>(matches)}});
+    }
+}
+
+// The popup list's look before the delegate: items styled per row by
+// the style sheet
+const char ItemStyleSheet[] = R"(
+    QListView { background-color: rgba(40, 40, 40, 255); color: white; border: none;
+                border-radius: 4px; padding: 4px; font-size: 14px; }
+    QListView::item { padding: 8px; border-radius: 4px; }
+    QListView::item:selected { background-color: #3daee9; }
+    QListView::item:hover { background-color: rgba(61, 174, 233, 100); }
+)";
+const char ViewStyleSheet[] = R"(
+    QListView { background-color: rgba(40, 40, 40, 255); color: white; border: none;
+                border-radius: 4px; padding: 4px; font-size: 14px; }
+)";
+
+// Filling, filtering and scrolling the popup's list, set up as in
+// MainWindow, or painted through the style sheet for comparison
+void benchList(Suite &suite, const TemplateStore &templates, bool delegate)
+{
+    if (!suite.enabledAny({"list.populate", "list.set_rows", "list.scroll_page"})) {
+        return;
+    }
+
+    const QString painting = delegate ? "delegate" : "stylesheet";
+    TemplateListModel model;
+    QListView view;
+    view.setModel(&model);
+    view.setUniformItemSizes(true);
+    if (delegate) {
+        view.setItemDelegate(new TemplateItemDelegate(&model, &view));
+        view.viewport()->setAttribute(Qt::WA_Hover);
+    }
+    view.setStyleSheet(delegate ? ViewStyleSheet : ItemStyleSheet);
+    view.resize(400, 500);
+    view.show();
+    QCoreApplication::processEvents();
+
+    suite.measure("list.populate", templates.size(), [&]() {
+        model.setTemplates(templates);
+        view.setCurrentIndex(model.index(0));
+        view.viewport()->repaint();
+    }, {{"painting", painting}});
+
+    // Swapping between a filtered row set and the full list
+    std::vector<uint32_t> every(templates.size());
+    std::vector<uint32_t> some;
+    for (uint32_t id = 0; id < templates.size(); ++id) {
+        every[id] = id;
+        if (templates.searchKey(id).find("かいぎ") != std::string_view::npos) {
+            some.push_back(id);
+        }
+    }
+    model.setTemplates(templates);
+    bool filtered = false;
+    suite.measure("list.set_rows", templates.size(), [&]() {
+        filtered = !filtered;
+        model.setRows(filtered ? some : every);
+        view.setCurrentIndex(model.index(0));
+        view.viewport()->repaint();
+    }, {{"painting", painting}, {"filtered_rows", static_cast<qint64>(some.size())}});
+
+    // Paging through the whole list, a page per sample, back to the top
+    // at the end; the first pass also fills the delegate's cache
+    if (!suite.enabled("list.scroll_page")) {
+        return;
+    }
+    model.setRows(every);
+    QScrollBar *scrollBar = view.verticalScrollBar();
+    std::vector<double> samples;
+    for (int i = 0; i < suite.iterations(); ++i) {
+        for (int page = 0; page < 50; ++page) {
+            const auto start = Clock::now();
+            scrollBar->setValue(scrollBar->value() >= scrollBar->maximum() ? 0
+                                                                           : scrollBar->value() + scrollBar->pageStep());
+            view.viewport()->repaint();
+            samples.push_back(elapsedMs(start));
+        }
+    }
+    suite.report("list.scroll_page", templates.size(), samples, {{"painting", painting}});
+}
+
+std::vector<size_t> parseSizes(const char *text)
+{
+    std::vector<size_t> sizes;
+    for (const QString &part : QString::fromLatin1(text).split(QLatin1Char(','), QString::SkipEmptyParts)) {
+        const size_t size = part.toULongLong();
+        if (size > 0) {
+            sizes.push_back(size);
+        }
+    }
+    return sizes;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<size_t> sizes = {100, 1000, 10000, 100000};
+    int iterations = 5;
+    QString filter;
+    QString output;
+    for (int i = 1; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (qstrcmp(argv[i], "--sizes") == 0 && hasValue) {
+            sizes = parseSizes(argv[++i]);
+        } else if (qstrcmp(argv[i], "--iterations") == 0 && hasValue) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        } else if (qstrcmp(argv[i], "--filter") == 0 && hasValue) {
+            filter = QString::fromLocal8Bit(argv[++i]);
+        } else if (qstrcmp(argv[i], "--output") == 0 && hasValue) {
+            output = QString::fromLocal8Bit(argv[++i]);
+        } else if (std::strtoul(argv[i], nullptr, 10) > 0) {
+            sizes = {std::strtoul(argv[i], nullptr, 10)};
+        } else {
+            std::cerr << "usage: clip-template-bench [--sizes N,N,...] [--iterations N] "
+                         "[--filter TEXT] [--output FILE] [template-count]" << std::endl;
+            return 2;
+        }
+    }
+
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+
+    Suite suite(filter, iterations);
+    for (size_t count : sizes) {
+        const std::vector<Template> templates = generateTemplates(count);
+        TemplateStore store;
+        benchStore(suite, templates, store);
+        benchConfig(suite, templates);
+        benchSearch(suite, store, templates);
+        benchKeystrokes(suite, store, TemplateSearch::Mode::Substring);
+        benchKeystrokes(suite, store, TemplateSearch::Mode::Fuzzy);
+        benchList(suite, store, false);
+        benchList(suite, store, true);
+    }
+
+    QJsonObject report;
+    report["benchmark"] = QStringLiteral("clip-template-bench");
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["cpu"] = QSysInfo::currentCpuArchitecture();
+    report["kernel"] = QSysInfo::kernelVersion();
+    report["iterations"] = iterations;
+    report["results"] = suite.results();
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if (output.isEmpty()) {
+        std::cout << json.constData();
+    } else {
+        QFile file(output);
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            std::cerr << "cannot write " << output.toStdString() << std::endl;
+            return 1;
+        }
+    }
+    return suite.failed() ? 1 : 0;
+}
@@ -0,0 +1,199 @@
+// End-to-end latency from launching clip-template to the pasted text
+// arriving in another window.
+//
+// Usage: clip-template-latency [options] [path/to/clip-template]
+//   --iterations N   pastes to measure (default 50)
+//   --xvfb           run on a private Xvfb server instead of $DISPLAY
+//   --daemon         start one resident instance; launches hand over to it
+//   --budget MS      exit with 1 if the p95 total latency exceeds MS
+//   --timeout MS     give up on an iteration after MS (default 5000)
+//
+// Exits with 77, which CTest counts as skipped, when there is no X server
+// to run on, e.g. Xvfb is not installed.
+//
+// A small window of our own holds the focus. Each iteration launches
+// clip-template in a throwaway HOME with a single known template, waits
+// for the popup to take the focus, presses Enter through XTest, and
+// then, as the target, fetches CLIPBOARD when the Ctrl+V arrives. The
+// report is JSON with p50/p95/p99 for each phase, in milliseconds.
+
+#include "x11harness.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XTest.h>
+
+using namespace x11harness;
+
+namespace {
+
+const char ExpectedText[] = "clip-template latency probe";
+
+struct Options {
+    int iterations = 50;
+    bool xvfb = false;
+    bool daemon = false;
+    double budget = 0;
+    int timeout = 5000;
+    std::string program = "./clip-template";
+};
+
+struct Sample {
+    double popup; // launch to the popup taking the focus
+    double paste; // Enter to the Ctrl+V reaching the target
+    double fetch; // Ctrl+V to the clipboard bytes
+    double total; // launch to the clipboard bytes
+};
+
+double percentile(std::vector<double> values, double p)
+{
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))];
+}
+
+void writeStats(const char *name, const std::vector<Sample> &samples, double Sample::*field, bool last)
+{
+    std::vector<double> values;
+    for (const auto &sample : samples) {
+        values.push_back(sample.*field);
+    }
+    std::printf("    {\"name\": \"%s\", \"samples\": %zu, \"p50_ms\": %.3f, \"p95_ms\": %.3f, "
+                "\"p99_ms\": %.3f, \"max_ms\": %.3f}%s\n",
+                name, values.size(), percentile(values, 0.50), percentile(values, 0.95),
+                percentile(values, 0.99), percentile(values, 1.0), last ? "" : ",");
+}
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--iterations") == 0 && hasValue) {
+            options.iterations = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--xvfb") == 0) {
+            options.xvfb = true;
+        } else if (std::strcmp(argv[i], "--daemon") == 0) {
+            options.daemon = true;
+        } else if (std::strcmp(argv[i], "--budget") == 0 && hasValue) {
+            options.budget = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--timeout") == 0 && hasValue) {
+            options.timeout = std::max(100, std::atoi(argv[++i]));
+        } else if (argv[i][0] != '-') {
+            options.program = argv[i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "usage: clip-template-latency [--iterations N] [--xvfb] [--daemon] [--budget MS] "
+                     "[--timeout MS] [path/to/clip-template]" << std::endl;
+        return 2;
+    }
+
+    pid_t xvfb = -1;
+    if (options.xvfb && (xvfb = startXvfb()) < 0) {
+        std::cerr << "cannot start Xvfb" << std::endl;
+        return SkipExitCode;
+    }
+    Display *display = XOpenDisplay(nullptr);
+    int eventBase, errorBase, major, minor;
+    if (!display || !XTestQueryExtension(display, &eventBase, &errorBase, &major, &minor)) {
+        std::cerr << "no X display with the XTEST extension" << std::endl;
+        stop(xvfb);
+        return SkipExitCode;
+    }
+
+    // One known template
+    const std::string home = prepareHome(std::string("templates:\n") +
+                                         "  - name: \"latency\"\n" +
+                                         "    content: " + yamlQuoted(ExpectedText) + "\n" +
+                                         "    category: \"bench\"\n");
+    const std::vector<std::string> environment = homeEnvironment(home);
+
+    int failures = 0;
+    std::vector<Sample> samples;
+    {
+        Target target(display);
+        target.focus();
+
+        pid_t daemon = -1;
+        if (options.daemon) {
+            daemon = spawn({options.program, "--daemon"}, environment);
+            usleep(500 * 1000); // let it load and start listening
+        }
+
+        for (int i = 0; i < options.iterations; ++i) {
+            target.focus();
+            const auto launched = Clock::now();
+            const pid_t popup = spawn({options.program}, environment);
+
+            Sample sample;
+            std::string text;
+            Clock::time_point pasted;
+            bool ok = target.waitForFocusOut(options.timeout);
+            const auto shown = Clock::now();
+            if (ok) {
+                target.pressReturn();
+                ok = target.waitForPaste(options.timeout, pasted, text) && text == ExpectedText;
+            }
+            const auto fetched = Clock::now();
+
+            // A standalone popup lingers to restore the clipboard
+            stop(popup);
+            if (!ok) {
+                ++failures;
+                std::cerr << "iteration " << i << " failed" << std::endl;
+                continue;
+            }
+            sample.popup = elapsedMs(launched, shown);
+            sample.paste = elapsedMs(shown, pasted);
+            sample.fetch = elapsedMs(pasted, fetched);
+            sample.total = elapsedMs(launched, fetched);
+            samples.push_back(sample);
+            std::cerr << "iteration " << i << ": " << sample.total << " ms" << std::endl;
+        }
+        stop(daemon);
+    }
+    XCloseDisplay(display);
+    stop(xvfb);
+    removeHome(home);
+
+    if (samples.empty()) {
+        std::cerr << "no successful iterations" << std::endl;
+        return 1;
+    }
+
+    std::printf("{\n  \"benchmark\": \"clip-template-latency\",\n  \"mode\": \"%s\",\n"
+                "  \"iterations\": %d,\n  \"failures\": %d,\n  \"results\": [\n",
+                options.daemon ? "daemon" : "standalone", options.iterations, failures);
+    writeStats("launch_to_popup", samples, &Sample::popup, false);
+    writeStats("enter_to_ctrl_v", samples, &Sample::paste, false);
+    writeStats("ctrl_v_to_text", samples, &Sample::fetch, false);
+    writeStats("launch_to_text", samples, &Sample::total, true);
+    std::printf("  ]\n}\n");
+
+    std::vector<double> totals;
+    for (const auto &sample : samples) {
+        totals.push_back(sample.total);
+    }
+    if (options.budget > 0 && percentile(totals, 0.95) > options.budget) {
+        std::cerr << "p95 " << percentile(totals, 0.95) << " ms exceeds the budget of " << options.budget
+                  << " ms" << std::endl;
+        return 1;
+    }
+    return failures > 0 ? 1 : 0;
+}
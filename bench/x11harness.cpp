@@ -0,0 +1,354 @@
+#include "x11harness.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XTest.h>
+#include <X11/keysym.h>
+
+namespace x11harness {
+
+double elapsedMs(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+pid_t spawn(const std::vector<std::string> &arguments, const std::vector<std::string> &environment)
+{
+    const pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+    for (const auto &variable : environment) {
+        putenv(const_cast<char *>(variable.c_str()));
+    }
+    std::vector<char *> argv;
+    for (const auto &argument : arguments) {
+        argv.push_back(const_cast<char *>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+    execvp(argv[0], argv.data());
+    _exit(127);
+}
+
+void stop(pid_t pid)
+{
+    if (pid <= 0) {
+        return;
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+}
+
+bool waitForExit(pid_t pid, int timeout)
+{
+    const auto deadline = Clock::now() + std::chrono::milliseconds(timeout);
+    while (waitpid(pid, nullptr, WNOHANG) == 0) {
+        if (Clock::now() >= deadline) {
+            return false;
+        }
+        usleep(10 * 1000);
+    }
+    return true;
+}
+
+pid_t startXvfb()
+{
+    int ready[2];
+    if (pipe(ready) != 0) {
+        return -1;
+    }
+    const pid_t pid = spawn({"Xvfb", "-displayfd", std::to_string(ready[1]), "-screen", "0", "1280x1024x24",
+                             "-nolisten", "tcp"}, {});
+    close(ready[1]);
+
+    // Xvfb writes the display number once it accepts connections
+    char number[16] = {};
+    pollfd fd = {ready[0], POLLIN, 0};
+    if (pid < 0 || poll(&fd, 1, 10000) <= 0 || read(ready[0], number, sizeof(number) - 1) <= 0) {
+        close(ready[0]);
+        stop(pid);
+        return -1;
+    }
+    close(ready[0]);
+    setenv("DISPLAY", (":" + std::string(number, std::strcspn(number, "\n"))).c_str(), 1);
+    return pid;
+}
+
+std::string prepareHome(const std::string &templatesYaml, const std::string &settingsYaml)
+{
+    char pattern[] = "/tmp/clip-template-harness-XXXXXX";
+    if (!mkdtemp(pattern)) {
+        return std::string();
+    }
+    const std::string home = pattern;
+    const std::string config = home + "/.config/clip-template";
+    mkdir((home + "/.config").c_str(), 0700);
+    mkdir(config.c_str(), 0700);
+    std::ofstream(config + "/templates.yaml") << templatesYaml;
+    if (!settingsYaml.empty()) {
+        std::ofstream(config + "/settings.yaml") << settingsYaml;
+    }
+    return home;
+}
+
+void removeHome(const std::string &home)
+{
+    if (home.empty()) {
+        return;
+    }
+    const pid_t pid = spawn({"rm", "-rf", home}, {});
+    waitpid(pid, nullptr, 0);
+}
+
+std::vector<std::string> homeEnvironment(const std::string &home)
+{
+    return {
+        "HOME=" + home,
+        "XDG_CONFIG_HOME=" + home + "/.config",
+        "XDG_CACHE_HOME=" + home + "/.cache",
+        "XDG_DATA_HOME=" + home + "/.local/share",
+    };
+}
+
+std::string yamlQuoted(const std::string &text)
+{
+    std::string quoted = "\"";
+    quoted.reserve(text.size() + 2);
+    for (char c : text) {
+        switch (c) {
+        case '"':
+            quoted += "\\\"";
+            break;
+        case '\\':
+            quoted += "\\\\";
+            break;
+        case '\n':
+            quoted += "\\n";
+            break;
+        case '\t':
+            quoted += "\\t";
+            break;
+        default:
+            quoted += c;
+            break;
+        }
+    }
+    quoted += '"';
+    return quoted;
+}
+
+Target::Target(Display *display)
+    : m_display(display)
+{
+    const int screen = DefaultScreen(display);
+    m_window = XCreateSimpleWindow(display, RootWindow(display, screen), 0, 0, 200, 100, 0,
+                                   BlackPixel(display, screen), WhitePixel(display, screen));
+    XSelectInput(display, m_window, KeyPressMask | FocusChangeMask | StructureNotifyMask | PropertyChangeMask);
+    XMapWindow(display, m_window);
+    waitFor(MapNotify, 5000);
+
+    m_clipboard = XInternAtom(display, "CLIPBOARD", False);
+    m_utf8 = XInternAtom(display, "UTF8_STRING", False);
+    m_incr = XInternAtom(display, "INCR", False);
+    m_property = XInternAtom(display, "_CLIP_TEMPLATE_HARNESS", False);
+    m_vKeycode = XKeysymToKeycode(display, XK_v);
+    m_returnKeycode = XKeysymToKeycode(display, XK_Return);
+}
+
+Target::~Target()
+{
+    XDestroyWindow(m_display, m_window);
+}
+
+void Target::focus()
+{
+    XSetInputFocus(m_display, m_window, RevertToPointerRoot, CurrentTime);
+    XSync(m_display, False);
+    XEvent event;
+    while (XCheckWindowEvent(m_display, m_window, KeyPressMask | FocusChangeMask, &event)) {
+    }
+}
+
+bool Target::waitForFocusOut(int timeout)
+{
+    return waitFor(FocusOut, timeout);
+}
+
+void Target::pressReturn()
+{
+    XTestFakeKeyEvent(m_display, m_returnKeycode, True, 0);
+    XTestFakeKeyEvent(m_display, m_returnKeycode, False, 0);
+    XFlush(m_display);
+}
+
+bool Target::waitForPaste(int timeout, Clock::time_point &pasted, std::string &text)
+{
+    const auto deadline = Clock::now() + std::chrono::milliseconds(timeout);
+    for (;;) {
+        XEvent event;
+        if (!nextEvent(event, deadline)) {
+            return false;
+        }
+        if (event.type == KeyPress && event.xkey.keycode == m_vKeycode && (event.xkey.state & ControlMask)) {
+            break;
+        }
+    }
+    pasted = Clock::now();
+
+    XConvertSelection(m_display, m_clipboard, m_utf8, m_property, m_window, CurrentTime);
+    XFlush(m_display);
+    for (;;) {
+        XEvent event;
+        if (!nextEvent(event, deadline)) {
+            return false;
+        }
+        if (event.type != SelectionNotify) {
+            continue;
+        }
+        if (event.xselection.property == None) {
+            return false;
+        }
+        Atom type = None;
+        int format = 0;
+        unsigned long items = 0;
+        unsigned long remaining = 0;
+        unsigned char *data = nullptr;
+        XGetWindowProperty(m_display, m_window, m_property, 0, 1 << 20, True, AnyPropertyType, &type,
+                           &format, &items, &remaining, &data);
+        if (type == m_incr) {
+            // Deleting the announcement asked for the first chunk
+            if (data) {
+                XFree(data);
+            }
+            text.clear();
+            return readIncr(deadline, text);
+        }
+        text.assign(data ? reinterpret_cast<char *>(data) : "", data ? items : 0);
+        if (data) {
+            XFree(data);
+        }
+        return true;
+    }
+}
+
+bool Target::waitForTyping(size_t size, int timeout, std::string &text)
+{
+    const auto deadline = Clock::now() + std::chrono::milliseconds(timeout);
+    while (text.size() < size) {
+        XEvent event;
+        if (!nextEvent(event, deadline)) {
+            return false;
+        }
+        if (event.type == MappingNotify) {
+            // Spare keycodes are remapped while typing
+            XRefreshKeyboardMapping(&event.xmapping);
+            continue;
+        }
+        if (event.type != KeyPress) {
+            continue;
+        }
+
+        char buffer[16];
+        KeySym keysym = NoSymbol;
+        XLookupString(&event.xkey, buffer, sizeof(buffer), &keysym, nullptr);
+        unsigned long codepoint = 0;
+        if (keysym == XK_Return) {
+            codepoint = '\n';
+        } else if (keysym == XK_Tab) {
+            codepoint = '\t';
+        } else if ((keysym >= 0x20 && keysym <= 0x7E) || (keysym >= 0xA0 && keysym <= 0xFF)) {
+            codepoint = keysym; // Latin-1 keysyms equal their code points
+        } else if ((keysym & 0xFF000000) == 0x01000000) {
+            codepoint = keysym & 0x00FFFFFF;
+        } else {
+            continue; // modifiers
+        }
+
+        if (codepoint < 0x80) {
+            text += static_cast<char>(codepoint);
+        } else if (codepoint < 0x800) {
+            text += static_cast<char>(0xC0 | (codepoint >> 6));
+            text += static_cast<char>(0x80 | (codepoint & 0x3F));
+        } else if (codepoint < 0x10000) {
+            text += static_cast<char>(0xE0 | (codepoint >> 12));
+            text += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            text += static_cast<char>(0x80 | (codepoint & 0x3F));
+        } else {
+            text += static_cast<char>(0xF0 | (codepoint >> 18));
+            text += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+            text += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            text += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+    }
+    return true;
+}
+
+bool Target::readIncr(Clock::time_point deadline, std::string &text)
+{
+    for (;;) {
+        XEvent event;
+        if (!nextEvent(event, deadline)) {
+            return false;
+        }
+        if (event.type != PropertyNotify || event.xproperty.window != m_window ||
+            event.xproperty.atom != m_property || event.xproperty.state != PropertyNewValue) {
+            continue;
+        }
+
+        // Deleting each chunk asks for the next; an empty one ends it
+        Atom type = None;
+        int format = 0;
+        unsigned long items = 0;
+        unsigned long remaining = 0;
+        unsigned char *data = nullptr;
+        XGetWindowProperty(m_display, m_window, m_property, 0, 1 << 20, True, AnyPropertyType, &type,
+                           &format, &items, &remaining, &data);
+        const size_t size = data ? items * (format / 8) : 0;
+        if (data) {
+            text.append(reinterpret_cast<char *>(data), size);
+            XFree(data);
+        }
+        XFlush(m_display);
+        if (size == 0) {
+            return true;
+        }
+    }
+}
+
+bool Target::waitFor(int type, int timeout)
+{
+    const auto deadline = Clock::now() + std::chrono::milliseconds(timeout);
+    XEvent event;
+    while (nextEvent(event, deadline)) {
+        if (event.type == type) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Target::nextEvent(XEvent &event, Clock::time_point deadline)
+{
+    while (!XPending(m_display)) {
+        const int left = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count());
+        if (left <= 0) {
+            return false;
+        }
+        pollfd fd = {ConnectionNumber(m_display), POLLIN, 0};
+        poll(&fd, 1, left);
+    }
+    XNextEvent(m_display, &event);
+    return true;
+}
+
+} // namespace x11harness
@@ -0,0 +1,81 @@
+#ifndef X11HARNESS_H
+#define X11HARNESS_H
+
+// Drives a built clip-template over X11 from the outside: a private Xvfb,
+// a throwaway HOME with known templates, and a window of our own that
+// plays the paste target. Shared by clip-template-latency and the paste
+// tests.
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include <X11/Xlib.h>
+
+namespace x11harness {
+
+using Clock = std::chrono::steady_clock;
+
+// Exit code CTest counts as skipped (SKIP_RETURN_CODE), for machines
+// without an X server to run on
+const int SkipExitCode = 77;
+
+double elapsedMs(Clock::time_point from, Clock::time_point to);
+
+pid_t spawn(const std::vector<std::string> &arguments, const std::vector<std::string> &environment);
+void stop(pid_t pid);
+// False if the process was still running after timeout ms
+bool waitForExit(pid_t pid, int timeout);
+
+// Starts Xvfb on a free display and points DISPLAY at it; -1 on failure
+pid_t startXvfb();
+
+// A throwaway HOME whose clip-template config holds the given files, so
+// runs neither read nor touch the user's; empty on failure
+std::string prepareHome(const std::string &templatesYaml, const std::string &settingsYaml = std::string());
+void removeHome(const std::string &home);
+// HOME and the XDG directories pointing into it
+std::vector<std::string> homeEnvironment(const std::string &home);
+
+// text as a double-quoted YAML scalar
+std::string yamlQuoted(const std::string &text);
+
+class Target {
+public:
+    explicit Target(Display *display);
+    ~Target();
+
+    void focus();
+
+    // Waits for the popup to take the focus from us
+    bool waitForFocusOut(int timeout);
+
+    void pressReturn();
+
+    // Waits for Ctrl+V, then converts CLIPBOARD and reads the text,
+    // following INCR transfers
+    bool waitForPaste(int timeout, Clock::time_point &pasted, std::string &text);
+
+    // Collects typed characters as UTF-8 until size bytes arrived; false
+    // if they did not within timeout ms
+    bool waitForTyping(size_t size, int timeout, std::string &text);
+
+private:
+    bool waitFor(int type, int timeout);
+    bool nextEvent(XEvent &event, Clock::time_point deadline);
+    bool readIncr(Clock::time_point deadline, std::string &text);
+
+    Display *m_display;
+    Window m_window;
+    Atom m_clipboard;
+    Atom m_utf8;
+    Atom m_incr;
+    Atom m_property;
+    KeyCode m_vKeycode;
+    KeyCode m_returnKeycode;
+};
+
+} // namespace x11harness
+
+#endif // X11HARNESS_H
@@ -1,4 +1,7 @@
 #include "clipboardhandler.h"
+#include "x11connection.h"
+#include "selectionowner.h"
+#include "trace.h"
 #include <QApplication>
 #include <QClipboard>
 #include <QString>
@@ -7,44 +10,59 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/XTest.h>
-#include <X11/keysym.h>
 #undef None
 #undef KeyPress
 #undef KeyRelease
 #undef FocusIn
 #undef FocusOut
-#include <unistd.h>
 
-ClipboardHandler::ClipboardHandler() = default;
+ClipboardHandler::ClipboardHandler()
+    : m_selectionOwner(std::make_unique<SelectionOwner>())
+{
+}
+
 ClipboardHandler::~ClipboardHandler() = default;
 
 void ClipboardHandler::copyToClipboard(const std::string &text)
 {
+    TraceScope trace("ClipboardHandler::copyToClipboard");
+    // The native owner serves the UTF-8 bytes as-is, with INCR for large text
+    if (m_selectionOwner->setText(text)) {
+        return;
+    }
+
     QClipboard *clipboard = QApplication::clipboard();
     clipboard->setText(QString::fromStdString(text));
 }
 
+bool ClipboardHandler::ownsClipboard() const
+{
+    return m_selectionOwner->ownsSelection();
+}
+
+const std::string &ClipboardHandler::clipboardText() const
+{
+    return m_selectionOwner->text();
+}
+
 void ClipboardHandler::pasteToWindow(Window window)
 {
     if (window == 0) return;
     
-    Display *display = XOpenDisplay(nullptr);
+    Display *display = X11Connection::instance().display();
     if (!display) return;
     
     // Set focus to the target window
     setFocusToWindow(display, window);
-    
-    // Wait a bit for focus to settle
-    usleep(50000); // 50ms
+    XSync(display, False);
     
     // Send Ctrl+V
-    sendCtrlV(display, window);
-    
-    XCloseDisplay(display);
+    sendCtrlV(display);
 }
 
 void ClipboardHandler::setFocusToWindow(Display *display, Window window)
 {
+    TraceScope trace("ClipboardHandler::setFocusToWindow");
     // Raise the window
     XRaiseWindow(display, window);
     
@@ -66,28 +84,38 @@ void ClipboardHandler::setFocusToWindow(Display *display, Window window)
     XFlush(display);
 }
 
-void ClipboardHandler::sendCtrlV(Display *display, Window window)
+void ClipboardHandler::sendCtrlV(Display *display)
 {
-    // Get keycodes
-    KeyCode ctrlKey = XKeysymToKeycode(display, XK_Control_L);
-    KeyCode vKey = XKeysymToKeycode(display, XK_v);
+    TraceScope trace("ClipboardHandler::sendCtrlV");
+    // Keycodes are looked up once per connection
+    KeyCode ctrlKey = X11Connection::instance().controlKeycode();
+    KeyCode vKey = X11Connection::instance().vKeycode();
     
-    // Press Ctrl
+    // XSync makes the server process each event before the next one is
+    // sent, which is what the old fixed sleeps approximated
     XTestFakeKeyEvent(display, ctrlKey, True, 0);
-    XFlush(display);
-    usleep(10000); // 10ms
+    XSync(display, False);
     
-    // Press V
     XTestFakeKeyEvent(display, vKey, True, 0);
-    XFlush(display);
-    usleep(10000); // 10ms
+    XSync(display, False);
     
-    // Release V
     XTestFakeKeyEvent(display, vKey, False, 0);
-    XFlush(display);
-    usleep(10000); // 10ms
+    XSync(display, False);
     
-    // Release Ctrl
     XTestFakeKeyEvent(display, ctrlKey, False, 0);
+    XSync(display, False);
+}
+
+void ClipboardHandler::sendCursorLeft(Display *display, int count)
+{
+    const KeyCode leftKey = X11Connection::instance().leftKeycode();
+    if (!leftKey || count <= 0) {
+        return;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        XTestFakeKeyEvent(display, leftKey, True, 0);
+        XTestFakeKeyEvent(display, leftKey, False, 0);
+    }
     XFlush(display);
 }
\ No newline at end of file
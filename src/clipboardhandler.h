@@ -1,6 +1,7 @@
 #ifndef CLIPBOARDHANDLER_H
 #define CLIPBOARDHANDLER_H
 
+#include <memory>
 #include <string>
 
 // Forward declarations for X11 types
@@ -9,17 +10,34 @@ typedef XID Window;
 struct _XDisplay;
 typedef struct _XDisplay Display;
 
+class SelectionOwner;
+
 class ClipboardHandler {
 public:
     ClipboardHandler();
     ~ClipboardHandler();
     
+    // Serves the text through the native selection owner, falling back
+    // to QClipboard when that is unavailable
     void copyToClipboard(const std::string &text);
+
+    // True while the native owner holds CLIPBOARD; Qt cannot read the
+    // clipboard back from it without blocking, so use clipboardText()
+    bool ownsClipboard() const;
+    const std::string &clipboardText() const;
+    SelectionOwner *selectionOwner() const { return m_selectionOwner.get(); }
+
+    // Focus the window and paste immediately, without waiting for the
+    // focus change (PasteSequencer waits for it)
     void pasteToWindow(Window window);
-    
-private:
-    void sendCtrlV(Display *display, Window window);
+
     void setFocusToWindow(Display *display, Window window);
+    void sendCtrlV(Display *display);
+    // Press Left count times, e.g. to put the cursor inside pasted text
+    void sendCursorLeft(Display *display, int count);
+
+private:
+    std::unique_ptr<SelectionOwner> m_selectionOwner;
 };
 
-#endif // CLIPBOARDHANDLER_H
\ No newline at end of file
+#endif // CLIPBOARDHANDLER_H
@@ -0,0 +1,454 @@
+#include "clipboardsnapshot.h"
+#include <QApplication>
+#include <QClipboard>
+#include <QDebug>
+#include <QMimeData>
+#include <QRegExp>
+#include <algorithm>
+#include <climits>
+
+// X11 headers must be included after Qt headers
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#undef None
+#undef KeyPress
+#undef KeyRelease
+#undef FocusIn
+#undef FocusOut
+
+namespace {
+const unsigned long NoAtom = 0L;       // None, undefined above to avoid clashing with Qt
+const size_t MaxRequests = 16;         // formats fetched per snapshot
+const qint64 DefaultByteLimit = 4 * 1024 * 1024;
+const int DefaultTimeout = 150;        // ms
+
+// Targets that describe the selection rather than hold its contents,
+// and legacy text encodings that duplicate UTF8_STRING
+const char *const SkippedTargets[] = {
+    "TARGETS", "MULTIPLE", "TIMESTAMP", "SAVE_TARGETS", "DELETE",
+    "INSERT_SELECTION", "INSERT_PROPERTY", "STRING", "TEXT", "COMPOUND_TEXT",
+};
+
+bool isSkippedTarget(const QString &name)
+{
+    for (const char *skipped : SkippedTargets) {
+        if (name == QLatin1String(skipped)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QString formatForTarget(const QString &name)
+{
+    return name == QLatin1String("UTF8_STRING") ? QStringLiteral("text/plain") : name;
+}
+}
+
+ClipboardSnapshot::ClipboardSnapshot(QObject *parent)
+    : QObject(parent)
+    , m_state(State::Idle)
+    , m_window(0)
+    , m_targetsProperty(0)
+    , m_byteLimit(DefaultByteLimit)
+    , m_allowedFormats({"*"})
+{
+    m_timeoutTimer.setSingleShot(true);
+    m_timeoutTimer.setInterval(DefaultTimeout);
+    connect(&m_timeoutTimer, &QTimer::timeout, this, [this]() {
+        if (m_state != State::Idle) {
+            qDebug() << "[clip-template] Clipboard snapshot timed out; keeping the formats received so far.";
+        }
+        finish();
+    });
+}
+
+ClipboardSnapshot::~ClipboardSnapshot()
+{
+    X11Connection::instance().removeEventHandler(this);
+    Display *display = X11Connection::instance().display();
+    if (display && m_window) {
+        XDestroyWindow(display, m_window);
+        XFlush(display);
+    }
+}
+
+void ClipboardSnapshot::setByteLimit(qint64 bytes)
+{
+    m_byteLimit = std::max<qint64>(0, bytes);
+}
+
+void ClipboardSnapshot::setAllowedFormats(const QStringList &patterns)
+{
+    m_allowedFormats = patterns;
+}
+
+void ClipboardSnapshot::setTimeout(int msecs)
+{
+    m_timeoutTimer.setInterval(std::max(0, msecs));
+}
+
+void ClipboardSnapshot::capture()
+{
+    if (m_state != State::Idle) {
+        return;
+    }
+
+    if (!ensureWindow()) {
+        // No X connection of our own: fall back to Qt, which blocks
+        emit captured(captureFromQt());
+        return;
+    }
+
+    X11Connection &x11 = X11Connection::instance();
+    Display *display = x11.display();
+    const Atom clipboard = x11.atom(X11Connection::Clipboard);
+    if (XGetSelectionOwner(display, clipboard) == NoAtom) {
+        emit captured(nullptr);
+        return;
+    }
+
+    m_requests.clear();
+    m_state = State::WaitingForTargets;
+    XConvertSelection(display, clipboard, x11.atom(X11Connection::Targets), m_targetsProperty, m_window, CurrentTime);
+    XFlush(display);
+    m_timeoutTimer.start();
+}
+
+void ClipboardSnapshot::finish()
+{
+    if (m_state != State::Idle) {
+        complete();
+    }
+}
+
+bool ClipboardSnapshot::x11Event(XEvent *event)
+{
+    if (m_state == State::Idle) {
+        return false;
+    }
+
+    switch (event->type) {
+    case SelectionNotify:
+        if (event->xselection.requestor != m_window) {
+            return false;
+        }
+        if (m_state == State::WaitingForTargets) {
+            if (event->xselection.property == NoAtom) {
+                complete();
+            } else {
+                handleTargets();
+            }
+        } else {
+            handleSelectionNotify(event->xselection.target, event->xselection.property);
+        }
+        return true;
+
+    case PropertyNotify:
+        if (event->xproperty.window != m_window || event->xproperty.state != PropertyNewValue) {
+            return false;
+        }
+        handleIncrementalChunk(event->xproperty.atom);
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool ClipboardSnapshot::ensureWindow()
+{
+    X11Connection &x11 = X11Connection::instance();
+    Display *display = x11.display();
+    if (!display) {
+        return false;
+    }
+    if (m_window) {
+        return true;
+    }
+
+    m_window = XCreateSimpleWindow(display, DefaultRootWindow(display), -10, -10, 1, 1, 0, 0, 0);
+    XSelectInput(display, m_window, PropertyChangeMask);
+
+    // One property per concurrent request, interned in a single round trip
+    std::vector<QByteArray> names;
+    names.push_back("_CLIP_TEMPLATE_SNAPSHOT_TARGETS");
+    for (size_t i = 0; i < MaxRequests; ++i) {
+        names.push_back("_CLIP_TEMPLATE_SNAPSHOT_" + QByteArray::number(static_cast<int>(i)));
+    }
+    std::vector<char *> namePointers;
+    for (auto &name : names) {
+        namePointers.push_back(name.data());
+    }
+    std::vector<Atom> atoms(names.size(), NoAtom);
+    XInternAtoms(display, namePointers.data(), static_cast<int>(namePointers.size()), False, atoms.data());
+    m_targetsProperty = atoms[0];
+    m_dataProperties.assign(atoms.begin() + 1, atoms.end());
+
+    x11.addEventHandler(this);
+    return true;
+}
+
+bool ClipboardSnapshot::isAllowed(const QString &format) const
+{
+    for (const QString &pattern : m_allowedFormats) {
+        if (QRegExp(pattern, Qt::CaseInsensitive, QRegExp::Wildcard).exactMatch(format)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int ClipboardSnapshot::priorityOf(const QString &format)
+{
+    if (format == QLatin1String("text/plain")) {
+        return 0;
+    }
+    if (format.startsWith(QLatin1String("text/plain"))) {
+        return 1;
+    }
+    if (format.startsWith(QLatin1String("text/"))) {
+        return 2;
+    }
+    if (format.startsWith(QLatin1String("image/"))) {
+        return 4; // the slowest to produce and the largest; dropped first
+    }
+    return 3;
+}
+
+void ClipboardSnapshot::handleTargets()
+{
+    X11Connection &x11 = X11Connection::instance();
+    Display *display = x11.display();
+
+    Atom type = NoAtom;
+    int format = 0;
+    unsigned long count = 0;
+    unsigned long remaining = 0;
+    unsigned char *data = nullptr;
+    XGetWindowProperty(display, m_window, m_targetsProperty, 0, 1024, True, XA_ATOM,
+                       &type, &format, &count, &remaining, &data);
+    if (!data || type != XA_ATOM || format != 32 || count == 0) {
+        if (data) {
+            XFree(data);
+        }
+        complete();
+        return;
+    }
+
+    std::vector<Atom> targets(reinterpret_cast<Atom *>(data), reinterpret_cast<Atom *>(data) + count);
+    XFree(data);
+
+    // All target names in one round trip
+    std::vector<char *> names(targets.size(), nullptr);
+    if (!XGetAtomNames(display, targets.data(), static_cast<int>(targets.size()), names.data())) {
+        complete();
+        return;
+    }
+
+    bool hasUtf8 = false;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        hasUtf8 = hasUtf8 || (names[i] && qstrcmp(names[i], "UTF8_STRING") == 0);
+    }
+
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (!names[i]) {
+            continue;
+        }
+        const QString name = QString::fromLatin1(names[i]);
+        XFree(names[i]);
+
+        const QString mimeFormat = formatForTarget(name);
+        if (isSkippedTarget(name) || (hasUtf8 && name == QLatin1String("text/plain")) ||
+            !mimeFormat.contains(QLatin1Char('/')) || !isAllowed(mimeFormat)) {
+            continue;
+        }
+        m_requests.push_back({targets[i], NoAtom, mimeFormat, priorityOf(mimeFormat), false, false, QByteArray()});
+    }
+
+    // Cheapest first, so the cap drops the costly formats
+    std::stable_sort(m_requests.begin(), m_requests.end(), [](const Request &a, const Request &b) {
+        return a.priority < b.priority;
+    });
+    if (m_requests.size() > MaxRequests) {
+        m_requests.resize(MaxRequests);
+    }
+    if (m_requests.empty()) {
+        complete();
+        return;
+    }
+
+    // Ask for everything at once; replies are collected as they arrive
+    const Atom clipboard = x11.atom(X11Connection::Clipboard);
+    for (size_t i = 0; i < m_requests.size(); ++i) {
+        m_requests[i].property = m_dataProperties[i];
+        XConvertSelection(display, clipboard, m_requests[i].target, m_requests[i].property, m_window, CurrentTime);
+    }
+    XFlush(display);
+    m_state = State::WaitingForData;
+}
+
+void ClipboardSnapshot::handleSelectionNotify(Atom target, Atom property)
+{
+    auto it = std::find_if(m_requests.begin(), m_requests.end(), [&](const Request &request) {
+        return request.target == target && !request.done && !request.incremental;
+    });
+    if (it == m_requests.end()) {
+        return;
+    }
+    if (property == NoAtom) {
+        it->done = true; // refused: nothing to keep
+        finishIfDone();
+        return;
+    }
+
+    const X11Connection &x11 = X11Connection::instance();
+    Display *display = x11.display();
+
+    // Never read more than the cap; anything larger is dropped
+    const long maxLength = static_cast<long>(std::min<qint64>(m_byteLimit / 4 + 1, LONG_MAX / 4));
+    Atom type = NoAtom;
+    int format = 0;
+    unsigned long count = 0;
+    unsigned long remaining = 0;
+    unsigned char *data = nullptr;
+    XGetWindowProperty(display, m_window, property, 0, maxLength, False, AnyPropertyType,
+                       &type, &format, &count, &remaining, &data);
+
+    if (type == x11.atom(X11Connection::Incr)) {
+        const qint64 announced = (data && format == 32 && count > 0) ? *reinterpret_cast<long *>(data) : 0;
+        if (data) {
+            XFree(data);
+        }
+        if (announced > m_byteLimit) {
+            // Leave the property in place; the owner gives up on its own
+            it->done = true;
+            it->data.clear();
+        } else {
+            // Deleting the property asks the owner for the first chunk
+            it->incremental = true;
+            XDeleteProperty(display, m_window, property);
+            XFlush(display);
+        }
+        finishIfDone();
+        return;
+    }
+
+    if (data && format == 8 && remaining == 0) {
+        it->data = QByteArray(reinterpret_cast<const char *>(data), static_cast<int>(count));
+    }
+    if (data) {
+        XFree(data);
+    }
+    XDeleteProperty(display, m_window, property);
+    it->done = true;
+    finishIfDone();
+}
+
+void ClipboardSnapshot::handleIncrementalChunk(Atom property)
+{
+    auto it = std::find_if(m_requests.begin(), m_requests.end(), [&](const Request &request) {
+        return request.property == property && request.incremental && !request.done;
+    });
+    if (it == m_requests.end()) {
+        return;
+    }
+
+    Display *display = X11Connection::instance().display();
+    Atom type = NoAtom;
+    int format = 0;
+    unsigned long count = 0;
+    unsigned long remaining = 0;
+    unsigned char *data = nullptr;
+    XGetWindowProperty(display, m_window, property, 0, LONG_MAX / 4, True, AnyPropertyType,
+                       &type, &format, &count, &remaining, &data);
+
+    if (data && format == 8 && count > 0) {
+        it->data.append(reinterpret_cast<const char *>(data), static_cast<int>(count));
+    }
+    if (data) {
+        XFree(data);
+    }
+
+    if (count == 0) {
+        it->done = true; // a zero-length chunk ends the transfer
+    } else if (it->data.size() > m_byteLimit) {
+        // Over the cap: stop reading and let the owner time out
+        it->data.clear();
+        it->done = true;
+    }
+    XFlush(display);
+    finishIfDone();
+}
+
+void ClipboardSnapshot::finishIfDone()
+{
+    if (std::all_of(m_requests.begin(), m_requests.end(), [](const Request &request) { return request.done; })) {
+        complete();
+    }
+}
+
+void ClipboardSnapshot::complete()
+{
+    m_timeoutTimer.stop();
+    m_state = State::Idle;
+
+    // Requests are in priority order; formats that would exceed the cap are dropped
+    QMimeData *mimeData = nullptr;
+    qint64 total = 0;
+    int dropped = 0;
+    for (const auto &request : m_requests) {
+        if (!request.done || request.data.isEmpty()) {
+            dropped += request.done ? 0 : 1;
+            continue;
+        }
+        if (total + request.data.size() > m_byteLimit) {
+            ++dropped;
+            continue;
+        }
+        if (!mimeData) {
+            mimeData = new QMimeData();
+        }
+        mimeData->setData(request.format, request.data);
+        total += request.data.size();
+    }
+    m_requests.clear();
+
+    if (dropped > 0) {
+        qDebug() << "[clip-template] Clipboard snapshot dropped" << dropped << "format(s).";
+    }
+    emit captured(mimeData);
+}
+
+QMimeData *ClipboardSnapshot::captureFromQt() const
+{
+    const QMimeData *source = QApplication::clipboard()->mimeData();
+    if (!source) {
+        return nullptr;
+    }
+
+    QStringList formats;
+    for (const QString &format : source->formats()) {
+        if (isAllowed(format)) {
+            formats.append(format);
+        }
+    }
+    std::stable_sort(formats.begin(), formats.end(), [](const QString &a, const QString &b) {
+        return priorityOf(a) < priorityOf(b);
+    });
+
+    QMimeData *mimeData = nullptr;
+    qint64 total = 0;
+    for (const QString &format : formats) {
+        const QByteArray data = source->data(format);
+        if (data.isEmpty() || total + data.size() > m_byteLimit) {
+            continue;
+        }
+        if (!mimeData) {
+            mimeData = new QMimeData();
+        }
+        mimeData->setData(format, data);
+        total += data.size();
+    }
+    return mimeData;
+}
@@ -0,0 +1,86 @@
+#ifndef CLIPBOARDSNAPSHOT_H
+#define CLIPBOARDSNAPSHOT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <vector>
+#include "x11connection.h"
+
+class QMimeData;
+
+// Saves the current CLIPBOARD contents so they can be restored after a
+// paste, without ever blocking on the previous owner.
+//
+// Only the target list is read up front. The allowed formats (all of
+// them by default) are then requested all at once on the shared X
+// connection and collected as they arrive. Once every format has arrived,
+// the timeout has passed or finish() is called, the formats are kept
+// cheapest first (plain text, other text, then the rest, images last)
+// until the byte limit is reached.
+class ClipboardSnapshot : public QObject, public X11EventHandler
+{
+    Q_OBJECT
+
+public:
+    explicit ClipboardSnapshot(QObject *parent = nullptr);
+    ~ClipboardSnapshot();
+
+    void setByteLimit(qint64 bytes);
+    // Wildcard patterns such as "text/*"
+    void setAllowedFormats(const QStringList &patterns);
+    void setTimeout(int msecs);
+
+    // Start a capture; captured() follows, possibly after the timeout
+    void capture();
+    // End a running capture with the formats received so far; captured()
+    // is emitted before this returns
+    void finish();
+    bool isCapturing() const { return m_state != State::Idle; }
+
+    bool x11Event(XEvent *event) override;
+
+signals:
+    // The receiver owns data; nullptr when nothing was saved
+    void captured(QMimeData *data);
+
+private:
+    enum class State {
+        Idle,
+        WaitingForTargets,
+        WaitingForData
+    };
+
+    struct Request {
+        Atom target;
+        Atom property;
+        QString format;
+        int priority;
+        bool incremental;
+        bool done;
+        QByteArray data;
+    };
+
+    bool ensureWindow();
+    bool isAllowed(const QString &format) const;
+    static int priorityOf(const QString &format);
+    void handleTargets();
+    void handleSelectionNotify(Atom target, Atom property);
+    void handleIncrementalChunk(Atom property);
+    void finishIfDone();
+    void complete();
+    QMimeData *captureFromQt() const;
+
+    State m_state;
+    Window m_window;
+    Atom m_targetsProperty;
+    std::vector<Atom> m_dataProperties;
+    std::vector<Request> m_requests;
+    qint64 m_byteLimit;
+    QStringList m_allowedFormats;
+    QTimer m_timeoutTimer;
+};
+
+#endif // CLIPBOARDSNAPSHOT_H
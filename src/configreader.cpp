@@ -1,62 +1,354 @@
 #include "configreader.h"
+#include "trace.h"
 #include <yaml-cpp/yaml.h>
+#include <yaml-cpp/eventhandler.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <unordered_map>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t MaxBatchSize = 65536;
+
+bool syncFile(const std::string &path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    const bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+// Thrown out of the parser when the batch callback asks to stop
+struct ReadingStopped {};
+
+// Builds templates from parser events for the layout
+//   templates: [ {name: ..., content: ..., category: ..., shortcut: ...}, ... ]
+// and ignores everything else in the document.
+class TemplateEventHandler : public YAML::EventHandler
+{
+public:
+    TemplateEventHandler(size_t firstBatchSize, const ConfigReader::BatchCallback &onBatch)
+        : m_batchSize(std::max<size_t>(1, firstBatchSize))
+        , m_onBatch(onBatch)
+        , m_templateAnchor(YAML::NullAnchor)
+        , m_inTemplates(false)
+    {}
+
+    void flush()
+    {
+        if (!m_batch.empty()) {
+            if (!m_onBatch(m_batch)) {
+                throw ReadingStopped();
+            }
+            m_batch.clear();
+            m_batchSize = std::min(m_batchSize * 2, MaxBatchSize);
+        }
+    }
+
+    void OnDocumentStart(const YAML::Mark &) override {}
+    void OnDocumentEnd() override {}
+
+    void OnNull(const YAML::Mark &, YAML::anchor_t anchor) override
+    {
+        // "null", as YAML::Node::as<std::string>() reads `~`, `null` and
+        // a missing value, so existing files read as they always did
+        const std::string value = "null";
+        if (anchor != YAML::NullAnchor) {
+            m_anchors[anchor] = value;
+        }
+        onValue(value);
+    }
+
+    void OnAlias(const YAML::Mark &, YAML::anchor_t anchor) override
+    {
+        // An item of the templates sequence repeating an anchored template
+        if (m_inTemplates && m_frames.size() == 2) {
+            auto it = m_templateAnchors.find(anchor);
+            if (it != m_templateAnchors.end()) {
+                addTemplate(Template(it->second));
+            }
+            return;
+        }
+
+        auto it = m_anchors.find(anchor);
+        onValue(it != m_anchors.end() ? it->second : std::string());
+    }
+
+    void OnScalar(const YAML::Mark &, const std::string &, YAML::anchor_t anchor, const std::string &value) override
+    {
+        if (anchor != YAML::NullAnchor) {
+            m_anchors[anchor] = value;
+        }
+        onValue(value);
+    }
+
+    void OnSequenceStart(const YAML::Mark &, const std::string &, YAML::anchor_t, YAML::EmitterStyle::value) override
+    {
+        // The value of the root map's "templates" key
+        if (m_frames.size() == 1 && m_frames.back().isMap && !m_frames.back().expectKey &&
+            m_frames.back().key == "templates") {
+            m_inTemplates = true;
+        }
+        push(false);
+    }
+
+    void OnSequenceEnd() override
+    {
+        m_frames.pop_back();
+        if (m_frames.size() == 1) {
+            m_inTemplates = false;
+        }
+    }
+
+    void OnMapStart(const YAML::Mark &, const std::string &, YAML::anchor_t anchor, YAML::EmitterStyle::value) override
+    {
+        push(true);
+        if (inTemplate()) {
+            m_template = Template();
+            m_templateAnchor = anchor;
+        }
+    }
+
+    void OnMapEnd() override
+    {
+        if (inTemplate()) {
+            if (m_templateAnchor != YAML::NullAnchor) {
+                m_templateAnchors[m_templateAnchor] = m_template;
+            }
+            addTemplate(std::move(m_template));
+        }
+        m_frames.pop_back();
+    }
+
+private:
+    struct Frame {
+        bool isMap;
+        bool expectKey; // maps only: the next node is a key
+        std::string key;
+    };
+
+    // Directly inside one of the maps of the templates sequence
+    bool inTemplate() const { return m_inTemplates && m_frames.size() == 3 && m_frames.back().isMap; }
+
+    void addTemplate(Template &&tmpl)
+    {
+        m_batch.push_back(std::move(tmpl));
+        if (m_batch.size() >= m_batchSize) {
+            flush();
+        }
+    }
+
+    void push(bool isMap)
+    {
+        // A collection used as a map value consumes the pending key
+        if (!m_frames.empty() && m_frames.back().isMap) {
+            m_frames.back().expectKey = true;
+        }
+        m_frames.push_back({isMap, true, std::string()});
+    }
+
+    void onValue(const std::string &value)
+    {
+        if (m_frames.empty() || !m_frames.back().isMap) {
+            return;
+        }
+
+        Frame &frame = m_frames.back();
+        if (frame.expectKey) {
+            frame.key = value;
+            frame.expectKey = false;
+            return;
+        }
+        frame.expectKey = true;
+
+        if (!inTemplate()) {
+            return;
+        }
+        if (frame.key == "name") {
+            m_template.name = value;
+        } else if (frame.key == "content") {
+            m_template.content = value;
+        } else if (frame.key == "category") {
+            m_template.category = value;
+        } else if (frame.key == "shortcut") {
+            m_template.shortcut = parseShortcut(value);
+        }
+    }
+
+    static int parseShortcut(const std::string &value)
+    {
+        // An integer, else a leading digit
+        try {
+            return YAML::Node(value).as<int>();
+        } catch (...) {
+            if (!value.empty() && std::isdigit(static_cast<unsigned char>(value[0]))) {
+                return value[0] - '0';
+            }
+        }
+        return 0;
+    }
+
+    size_t m_batchSize;
+    const ConfigReader::BatchCallback &m_onBatch;
+    std::vector<Template> m_batch;
+    Template m_template;
+    YAML::anchor_t m_templateAnchor;
+    std::unordered_map<YAML::anchor_t, std::string> m_anchors;
+    std::unordered_map<YAML::anchor_t, Template> m_templateAnchors;
+    std::vector<Frame> m_frames;
+    bool m_inTemplates;
+};
+
+} // namespace
 
 ConfigReader::ConfigReader() = default;
 ConfigReader::~ConfigReader() = default;
 
-std::vector<Template> ConfigReader::readConfig(const std::string &filepath)
+bool ConfigReader::readConfig(const std::string &filepath, std::vector<Template> &templates)
+{
+    TraceScope trace("ConfigReader::readConfig");
+    trace.setDetail(filepath);
+    templates.clear();
+
+    // One parser for both, so they never disagree about a file
+    const bool read = readConfigStreaming(filepath, MaxBatchSize, [&templates](std::vector<Template> &batch) {
+        if (templates.empty()) {
+            templates.swap(batch);
+        } else {
+            templates.insert(templates.end(), std::make_move_iterator(batch.begin()),
+                             std::make_move_iterator(batch.end()));
+        }
+        return true;
+    });
+    if (!read) {
+        templates.clear();
+    }
+    return read;
+}
+
+Settings ConfigReader::readSettings(const std::string &filepath)
 {
-    std::vector<Template> templates;
+    TraceScope trace("ConfigReader::readSettings");
+    trace.setDetail(filepath);
+    Settings settings;
     
     try {
         YAML::Node config = YAML::LoadFile(filepath);
         
-        if (config["templates"]) {
-            for (const auto &node : config["templates"]) {
-                Template tmpl;
-                
-                if (node["name"]) {
-                    tmpl.name = node["name"].as<std::string>();
-                }
-                
-                if (node["content"]) {
-                    tmpl.content = node["content"].as<std::string>();
-                }
-                
-                if (node["category"]) {
-                    tmpl.category = node["category"].as<std::string>();
-                }
-                
-                if (node["shortcut"]) {
-                    try {
-                        tmpl.shortcut = node["shortcut"].as<int>();
-                    } catch (...) {
-                        // If shortcut is a string, try to parse it
-                        std::string shortcutStr = node["shortcut"].as<std::string>();
-                        if (!shortcutStr.empty() && std::isdigit(shortcutStr[0])) {
-                            tmpl.shortcut = shortcutStr[0] - '0';
-                        }
-                    }
-                }
-                
-                templates.push_back(tmpl);
+        if (const YAML::Node search = config["search"]) {
+            if (search["mode"]) {
+                settings.searchMode = search["mode"].as<std::string>();
+            }
+            
+            if (search["fuzzy_limit"]) {
+                settings.fuzzyResultLimit = search["fuzzy_limit"].as<int>();
+            }
+        }
+        
+        if (const YAML::Node paste = config["paste"]) {
+            if (paste["focus_timeout_ms"]) {
+                settings.focusTimeout = paste["focus_timeout_ms"].as<int>();
+            }
+            
+            if (paste["transfer_timeout_ms"]) {
+                settings.transferTimeout = paste["transfer_timeout_ms"].as<int>();
+            }
+            
+            if (paste["mode"]) {
+                settings.pasteMode = paste["mode"].as<std::string>();
+            }
+            
+            if (paste["type_batch_size"]) {
+                settings.typeBatchSize = paste["type_batch_size"].as<int>();
+            }
+            
+            if (paste["type_batch_interval_ms"]) {
+                settings.typeBatchInterval = paste["type_batch_interval_ms"].as<int>();
+            }
+        }
+        
+        if (const YAML::Node clipboard = config["clipboard"]) {
+            if (clipboard["snapshot_max_bytes"]) {
+                settings.snapshotMaxBytes = clipboard["snapshot_max_bytes"].as<long long>();
+            }
+            
+            if (clipboard["snapshot_formats"]) {
+                settings.snapshotFormats = clipboard["snapshot_formats"].as<std::vector<std::string>>();
+            }
+            
+            if (clipboard["snapshot_timeout_ms"]) {
+                settings.snapshotTimeout = clipboard["snapshot_timeout_ms"].as<int>();
             }
         }
     } catch (const YAML::Exception &e) {
-        std::cerr << "Error reading config file: " << e.what() << std::endl;
-    } catch (const std::exception &e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+        std::cerr << "Error reading settings file: " << e.what() << std::endl;
     }
     
-    return templates;
+    return settings;
 }
 
-bool ConfigReader::writeConfig(const std::string &filepath, const std::vector<Template> &templates)
+bool ConfigReader::readConfigStreaming(const std::string &filepath, size_t firstBatchSize, const BatchCallback &onBatch)
 {
+    TraceScope trace("ConfigReader::readConfigStreaming");
+    trace.setDetail(filepath);
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error reading config file: cannot open " << filepath << std::endl;
+        return false;
+    }
+
+    TemplateEventHandler handler(firstBatchSize, onBatch);
     try {
-        YAML::Emitter out;
+        YAML::Parser parser(file);
+        parser.HandleNextDocument(handler);
+        handler.flush();
+    } catch (const ReadingStopped &) {
+        return false;
+    } catch (const YAML::Exception &e) {
+        std::cerr << "Error reading config file: " << e.what() << std::endl;
+        try {
+            handler.flush();
+        } catch (const ReadingStopped &) {
+        }
+        return false;
+    }
+
+    return true;
+}
+
+bool ConfigReader::writeConfig(const std::string &path, const std::vector<Template> &templates)
+{
+    TraceScope trace("ConfigReader::writeConfig");
+    trace.setDetail(path);
+    // A symlinked file (dotfile repositories) is written where it points,
+    // so the rename below replaces the target and keeps the link
+    char resolved[PATH_MAX];
+    const std::string filepath = ::realpath(path.c_str(), resolved) ? std::string(resolved) : path;
+
+    // Written to a temporary file next to it, synced, and renamed over the
+    // original, so a crash leaves either the old file or the new one
+    const std::string partial = filepath + ".tmp";
+    try {
+        std::ofstream file(partial, std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Error writing config file: cannot open " << partial << std::endl;
+            return false;
+        }
+
+        // Emitted straight into the file instead of built in memory first
+        YAML::Emitter out(file);
         out << YAML::BeginMap;
         out << YAML::Key << "templates";
         out << YAML::Value << YAML::BeginSeq;
@@ -79,16 +371,32 @@ bool ConfigReader::writeConfig(const std::string &filepath, const std::vector<Te
         
         out << YAML::EndSeq;
         out << YAML::EndMap;
-        
-        std::ofstream file(filepath);
-        if (file.is_open()) {
-            file << out.c_str();
-            file.close();
-            return true;
+        file << '\n';
+        file.close();
+        if (!out.good() || !file) {
+            std::cerr << "Error writing config file: " << out.GetLastError() << std::endl;
+            std::remove(partial.c_str());
+            return false;
         }
     } catch (const std::exception &e) {
         std::cerr << "Error writing config file: " << e.what() << std::endl;
+        std::remove(partial.c_str());
+        return false;
     }
-    
-    return false;
+
+    // The new file keeps the old one's permissions
+    struct stat original;
+    if (::stat(filepath.c_str(), &original) == 0) {
+        ::chmod(partial.c_str(), original.st_mode & 07777);
+    }
+
+    if (!syncFile(partial) || std::rename(partial.c_str(), filepath.c_str()) != 0) {
+        std::cerr << "Error writing config file: cannot replace " << filepath << std::endl;
+        std::remove(partial.c_str());
+        return false;
+    }
+    // The rename itself is only durable once the directory is synced
+    const size_t slash = filepath.rfind('/');
+    syncFile(slash == std::string::npos ? "." : filepath.substr(0, slash == 0 ? 1 : slash));
+    return true;
 }
\ No newline at end of file
@@ -1,17 +1,33 @@
 #ifndef CONFIGREADER_H
 #define CONFIGREADER_H
 
+#include <functional>
 #include <string>
 #include <vector>
 #include "templatemanager.h"
+#include "settings.h"
 
 class ConfigReader {
 public:
     ConfigReader();
     ~ConfigReader();
     
-    std::vector<Template> readConfig(const std::string &filepath);
+    // Return false to stop reading
+    using BatchCallback = std::function<bool(std::vector<Template> &batch)>;
+
+    // Every template at once, parsed by readConfigStreaming. False, leaving
+    // templates empty, if the file cannot be read or parsed; a file
+    // without templates is not an error
+    bool readConfig(const std::string &filepath, std::vector<Template> &templates);
+    // Templates are handed to onBatch while the file is still being
+    // parsed, in batches that start at firstBatchSize and double up to a
+    // limit. Returns false on errors or when stopped; batches delivered
+    // before that stay valid.
+    bool readConfigStreaming(const std::string &filepath, size_t firstBatchSize, const BatchCallback &onBatch);
+    // Replaces the file atomically, keeping its permissions; a symlink
+    // keeps pointing at the rewritten file
     bool writeConfig(const std::string &filepath, const std::vector<Template> &templates);
+    Settings readSettings(const std::string &filepath);
     
 private:
     Template parseTemplate(const void *node);
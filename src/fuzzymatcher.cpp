@@ -0,0 +1,302 @@
+#include "fuzzymatcher.h"
+#include "templatestore.h"
+#include <algorithm>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CLIP_TEMPLATE_X86_SIMD 1
+#else
+#define CLIP_TEMPLATE_X86_SIMD 0
+#endif
+
+namespace {
+
+// Scoring constants follow fzf's v1 algorithm
+const int ScoreMatch = 16;
+const int ScoreGapStart = -3;
+const int ScoreGapExtension = -1;
+const int BonusBoundary = 8;
+const int BonusConsecutive = -(ScoreGapStart + ScoreGapExtension);
+const int BonusFirstCharMultiplier = 2;
+const int BonusNameField = 16;
+
+// Bit for one byte of folded text, or -1 for bytes that carry no
+// information (UTF-8 lead bytes: every kana starts with 0xE3)
+int byteClass(unsigned char c)
+{
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a';
+    }
+    if (c >= '0' && c <= '9') {
+        return 26 + (c - '0');
+    }
+    if (c < 0x80) {
+        return 36 + (c & 0x3);
+    }
+    if (c < 0xC0) {
+        return 40 + (c & 0x3F) % 24;
+    }
+    return -1;
+}
+
+bool isBoundary(unsigned char c)
+{
+    switch (c) {
+    case '\0': case ' ': case '\t': case '\n': case '\r':
+    case '-': case '_': case '/': case '.': case ':': case ',':
+    case '(': case ')': case '[': case ']': case '"': case '\'':
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Characters in a UTF-8 byte range (continuation bytes are not counted)
+int countChars(const char *text, size_t size)
+{
+    int count = 0;
+    for (size_t i = 0; i < size; ++i) {
+        if ((static_cast<unsigned char>(text[i]) & 0xC0) != 0x80) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+#if CLIP_TEMPLATE_X86_SIMD
+void prefilterSse2(const uint64_t *masks, size_t count, uint64_t query, std::vector<uint32_t> &out)
+{
+    const __m128i wanted = _mm_set1_epi64x(static_cast<long long>(query));
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const __m128i keys = _mm_loadu_si128(reinterpret_cast<const __m128i *>(masks + i));
+        // Bits the query needs but the key lacks; all-zero lanes pass
+        const __m128i missing = _mm_andnot_si128(keys, wanted);
+        const int zeroBytes = _mm_movemask_epi8(_mm_cmpeq_epi8(missing, zero));
+        if ((zeroBytes & 0x00FF) == 0x00FF) {
+            out.push_back(static_cast<uint32_t>(i));
+        }
+        if ((zeroBytes & 0xFF00) == 0xFF00) {
+            out.push_back(static_cast<uint32_t>(i + 1));
+        }
+    }
+    for (; i < count; ++i) {
+        if ((masks[i] & query) == query) {
+            out.push_back(static_cast<uint32_t>(i));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void prefilterAvx2(const uint64_t *masks, size_t count, uint64_t query, std::vector<uint32_t> &out)
+{
+    const __m256i wanted = _mm256_set1_epi64x(static_cast<long long>(query));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m256i keys = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(masks + i));
+        const __m256i covered = _mm256_cmpeq_epi64(_mm256_and_si256(keys, wanted), wanted);
+        int lanes = _mm256_movemask_pd(_mm256_castsi256_pd(covered));
+        while (lanes) {
+            const int lane = __builtin_ctz(lanes);
+            out.push_back(static_cast<uint32_t>(i + lane));
+            lanes &= lanes - 1;
+        }
+    }
+    for (; i < count; ++i) {
+        if ((masks[i] & query) == query) {
+            out.push_back(static_cast<uint32_t>(i));
+        }
+    }
+}
+
+bool cpuHasAvx2()
+{
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    return hasAvx2;
+}
+#endif
+
+} // namespace
+
+FuzzyMatcher::FuzzyMatcher()
+    : m_queryMask(0)
+    , m_simdEnabled(CLIP_TEMPLATE_X86_SIMD)
+{
+}
+
+FuzzyMatcher::~FuzzyMatcher() = default;
+
+void FuzzyMatcher::setTemplates(const TemplateStore &templates)
+{
+    m_masks.clear();
+    m_masks.reserve(templates.size());
+    for (uint32_t id = 0; id < templates.size(); ++id) {
+        m_masks.push_back(byteMask(templates.searchKey(id)));
+    }
+}
+
+void FuzzyMatcher::updateTemplate(uint32_t id, std::string_view searchKey)
+{
+    if (id >= m_masks.size()) {
+        m_masks.resize(id + 1, 0);
+    }
+    m_masks[id] = byteMask(searchKey);
+}
+
+void FuzzyMatcher::setQuery(const std::string &foldedQuery)
+{
+    m_tokens.clear();
+    for (size_t i = 0; i < foldedQuery.size();) {
+        size_t next = i + 1;
+        while (next < foldedQuery.size() && (static_cast<unsigned char>(foldedQuery[next]) & 0xC0) == 0x80) {
+            ++next;
+        }
+        m_tokens.push_back(foldedQuery.substr(i, next - i));
+        i = next;
+    }
+    m_queryMask = byteMask(foldedQuery);
+}
+
+void FuzzyMatcher::setSimdEnabled(bool enabled)
+{
+    m_simdEnabled = enabled && CLIP_TEMPLATE_X86_SIMD;
+}
+
+void FuzzyMatcher::prefilter(std::vector<uint32_t> &candidates) const
+{
+    candidates.clear();
+    candidates.reserve(m_masks.size());
+#if CLIP_TEMPLATE_X86_SIMD
+    if (m_simdEnabled) {
+        if (cpuHasAvx2()) {
+            prefilterAvx2(m_masks.data(), m_masks.size(), m_queryMask, candidates);
+        } else {
+            prefilterSse2(m_masks.data(), m_masks.size(), m_queryMask, candidates);
+        }
+        return;
+    }
+#endif
+    prefilterScalar(candidates);
+}
+
+void FuzzyMatcher::prefilterScalar(std::vector<uint32_t> &candidates) const
+{
+    for (size_t i = 0; i < m_masks.size(); ++i) {
+        if ((m_masks[i] & m_queryMask) == m_queryMask) {
+            candidates.push_back(static_cast<uint32_t>(i));
+        }
+    }
+}
+
+bool FuzzyMatcher::score(std::string_view key, int &score) const
+{
+    if (m_tokens.empty()) {
+        score = 0;
+        return true;
+    }
+
+    // Match each field on its own so a match never spans name and content
+    bool matched = false;
+    int best = 0;
+    size_t fieldStart = 0;
+    for (int field = 0; fieldStart <= key.size(); ++field) {
+        size_t fieldEnd = key.find('\0', fieldStart);
+        if (fieldEnd == std::string_view::npos) {
+            fieldEnd = key.size();
+        }
+
+        int fieldScore = 0;
+        if (scoreField(key.data() + fieldStart, fieldEnd - fieldStart, fieldScore)) {
+            if (field == 0) {
+                fieldScore += BonusNameField;
+            }
+            if (!matched || fieldScore > best) {
+                best = fieldScore;
+            }
+            matched = true;
+        }
+        fieldStart = fieldEnd + 1;
+    }
+
+    score = best;
+    return matched;
+}
+
+bool FuzzyMatcher::scoreField(const char *text, size_t size, int &score) const
+{
+    const std::string_view field(text, size);
+
+    // Forward pass: earliest end of a full match
+    size_t pos = 0;
+    size_t first = std::string_view::npos;
+    for (const auto &token : m_tokens) {
+        const size_t found = field.find(token, pos);
+        if (found == std::string_view::npos) {
+            return false;
+        }
+        if (first == std::string_view::npos) {
+            first = found;
+        }
+        pos = found + token.size();
+    }
+    const size_t end = pos;
+
+    // Backward pass: latest start that still matches, giving the shortest window
+    size_t start = end;
+    for (size_t i = m_tokens.size(); i-- > 0;) {
+        start = first + field.substr(first, start - first).rfind(m_tokens[i]);
+    }
+
+    // Score the window left to right
+    score = 0;
+    pos = start;
+    size_t previousEnd = std::string_view::npos;
+    for (size_t i = 0; i < m_tokens.size(); ++i) {
+        const size_t found = field.find(m_tokens[i], pos);
+        int bonus = (found == 0 || isBoundary(static_cast<unsigned char>(text[found - 1]))) ? BonusBoundary : 0;
+        if (previousEnd != std::string_view::npos) {
+            if (found == previousEnd) {
+                bonus = std::max(bonus, BonusConsecutive);
+            } else {
+                const int gap = countChars(text + previousEnd, found - previousEnd);
+                score += ScoreGapStart + ScoreGapExtension * (gap - 1);
+            }
+        }
+        if (i == 0) {
+            bonus *= BonusFirstCharMultiplier;
+        }
+        score += ScoreMatch + bonus;
+        previousEnd = found + m_tokens[i].size();
+        pos = previousEnd;
+    }
+
+    return true;
+}
+
+void FuzzyMatcher::rank(std::vector<Match> &matches, size_t limit)
+{
+    auto better = [](const Match &a, const Match &b) {
+        return a.score != b.score ? a.score > b.score : a.id < b.id;
+    };
+
+    if (matches.size() > limit) {
+        std::partial_sort(matches.begin(), matches.begin() + limit, matches.end(), better);
+        matches.resize(limit);
+    } else {
+        std::sort(matches.begin(), matches.end(), better);
+    }
+}
+
+uint64_t FuzzyMatcher::byteMask(std::string_view text)
+{
+    uint64_t mask = 0;
+    for (unsigned char c : text) {
+        const int bit = byteClass(c);
+        if (bit >= 0) {
+            mask |= uint64_t(1) << bit;
+        }
+    }
+    return mask;
+}
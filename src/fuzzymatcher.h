@@ -0,0 +1,60 @@
+#ifndef FUZZYMATCHER_H
+#define FUZZYMATCHER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class TemplateStore;
+
+// fzf-style fuzzy matching over folded search keys: the query's
+// characters must appear in order, and matches are scored by word
+// boundaries, consecutive runs and gaps.
+//
+// Before scoring, keys are rejected with a per-key bitmask of the byte
+// classes they contain; this prefilter runs four (AVX2) or two (SSE2)
+// keys per instruction, with a scalar fallback that gives the same result.
+class FuzzyMatcher {
+public:
+    struct Match {
+        uint32_t id;
+        int score;
+    };
+
+    FuzzyMatcher();
+    ~FuzzyMatcher();
+
+    // Precompute the byte-class masks; index i is template slot i
+    void setTemplates(const TemplateStore &templates);
+    // Recompute one mask after slot id changed or was appended
+    void updateTemplate(uint32_t id, std::string_view searchKey);
+
+    void setQuery(const std::string &foldedQuery);
+
+    // Off forces the scalar prefilter (used to cross-check the SIMD path)
+    void setSimdEnabled(bool enabled);
+    bool simdEnabled() const { return m_simdEnabled; }
+
+    // Ids, ascending, of every key that may contain the query
+    void prefilter(std::vector<uint32_t> &candidates) const;
+
+    // Score one folded key; false if the query is not a subsequence
+    bool score(std::string_view key, int &score) const;
+
+    // Keep the best `limit` matches, best first (ties keep list order)
+    static void rank(std::vector<Match> &matches, size_t limit);
+
+    static uint64_t byteMask(std::string_view text);
+
+private:
+    bool scoreField(const char *text, size_t size, int &score) const;
+    void prefilterScalar(std::vector<uint32_t> &candidates) const;
+
+    std::vector<uint64_t> m_masks;
+    std::vector<std::string> m_tokens; // query characters as UTF-8 sequences
+    uint64_t m_queryMask;
+    bool m_simdEnabled;
+};
+
+#endif // FUZZYMATCHER_H
@@ -0,0 +1,23 @@
+#ifndef HASHUTIL_H
+#define HASHUTIL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// 64-bit FNV-1a; used for cache keys and change detection, not security
+inline uint64_t fnv1a64(const char *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline uint64_t fnv1a64(std::string_view text, uint64_t hash = 14695981039346656037ULL)
+{
+    return fnv1a64(text.data(), text.size(), hash);
+}
+
+#endif // HASHUTIL_H
@@ -1,4 +1,5 @@
 #include "keyboardhandler.h"
+#include "x11connection.h"
 
 // X11 headers - order matters
 #include <X11/Xlib.h>
@@ -84,7 +85,11 @@ Window KeyboardHandler::getActiveWindow(Display *display)
     unsigned long nItems, bytesAfter;
     unsigned char *prop = nullptr;
     
-    Atom activeWindow = XInternAtom(display, "_NET_ACTIVE_WINDOW", False);
+    // Interned once on the shared connection; atoms are server-wide
+    Atom activeWindow = X11Connection::instance().atom(X11Connection::NetActiveWindow);
+    if (activeWindow == 0) {
+        activeWindow = XInternAtom(display, "_NET_ACTIVE_WINDOW", False);
+    }
     
     if (XGetWindowProperty(display, root, activeWindow, 0L, 1L, False,
                           33, &actualType, &actualFormat, // XA_WINDOW = 33
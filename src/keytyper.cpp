@@ -0,0 +1,262 @@
+#include "keytyper.h"
+#include <QDebug>
+#include <QString>
+#include <QVector>
+#include <algorithm>
+
+// X11 headers must be included after Qt headers
+#include <X11/Xlib.h>
+#include <X11/extensions/XTest.h>
+#include <X11/keysym.h>
+#undef None
+#undef KeyPress
+#undef KeyRelease
+#undef FocusIn
+#undef FocusOut
+
+namespace {
+const unsigned long NoKeySym = 0L;   // NoSymbol
+const size_t MaxSpareKeys = 16;
+const int DefaultBatchSize = 64;     // characters
+const int DefaultBatchInterval = 10; // ms
+const int RestoreDelay = 200;        // ms for the target to handle the last keys
+}
+
+KeyTyper::KeyTyper(QObject *parent)
+    : QObject(parent)
+    , m_position(0)
+    , m_shiftKeycode(0)
+    , m_batch(0)
+    , m_batchSize(DefaultBatchSize)
+{
+    m_batchTimer.setInterval(DefaultBatchInterval);
+    connect(&m_batchTimer, &QTimer::timeout, this, &KeyTyper::typeBatch);
+
+    m_restoreTimer.setSingleShot(true);
+    m_restoreTimer.setInterval(RestoreDelay);
+    connect(&m_restoreTimer, &QTimer::timeout, this, [this]() {
+        restoreSpareKeys();
+        emit keymapRestored();
+    });
+}
+
+KeyTyper::~KeyTyper()
+{
+    restoreSpareKeys();
+}
+
+void KeyTyper::setBatchSize(int characters)
+{
+    m_batchSize = std::max(1, characters);
+}
+
+void KeyTyper::setBatchInterval(int msecs)
+{
+    m_batchTimer.setInterval(std::max(0, msecs));
+}
+
+bool KeyTyper::type(const std::string &text)
+{
+    if (!loadKeymap()) {
+        return false;
+    }
+    m_restoreTimer.stop();
+
+    m_keysyms.clear();
+    const QVector<uint> codepoints = QString::fromStdString(text).toUcs4();
+    m_keysyms.reserve(codepoints.size());
+    for (uint codepoint : codepoints) {
+        const KeySym keysym = keysymFor(codepoint);
+        if (keysym != NoKeySym) {
+            m_keysyms.push_back(keysym);
+        }
+    }
+    m_position = 0;
+
+    // First batch right away, the rest paced by the timer
+    m_batchTimer.start();
+    typeBatch();
+    return true;
+}
+
+bool KeyTyper::loadKeymap()
+{
+    Display *display = X11Connection::instance().display();
+    if (!display) {
+        return false;
+    }
+
+    // The whole keymap in one round trip
+    int minKeycode = 0;
+    int maxKeycode = 0;
+    XDisplayKeycodes(display, &minKeycode, &maxKeycode);
+    int perKeycode = 0;
+    KeySym *keysyms = XGetKeyboardMapping(display, static_cast<KeyCode>(minKeycode),
+                                          maxKeycode - minKeycode + 1, &perKeycode);
+    if (!keysyms) {
+        return false;
+    }
+
+    // Keep the spare keys we already assigned; they are still mapped
+    std::vector<KeyCode> assigned;
+    for (const auto &spare : m_spareKeys) {
+        if (spare.keysym != NoKeySym) {
+            assigned.push_back(spare.keycode);
+        }
+    }
+
+    m_keymap.clear();
+    std::vector<KeyCode> unused;
+    for (int keycode = minKeycode; keycode <= maxKeycode; ++keycode) {
+        const KeySym *entry = keysyms + (keycode - minKeycode) * perKeycode;
+        const KeyCode code = static_cast<KeyCode>(keycode);
+        if (std::find(assigned.begin(), assigned.end(), code) != assigned.end()) {
+            continue;
+        }
+
+        bool empty = true;
+        for (int i = 0; i < perKeycode; ++i) {
+            empty = empty && entry[i] == NoKeySym;
+        }
+        if (empty) {
+            unused.push_back(code);
+            continue;
+        }
+
+        // Only the unshifted and shifted levels; other levels need
+        // modifiers that vary between layouts
+        for (int level = 0; level < std::min(perKeycode, 2); ++level) {
+            if (entry[level] != NoKeySym && !m_keymap.count(entry[level])) {
+                m_keymap[entry[level]] = {code, level == 1};
+            }
+        }
+    }
+    XFree(keysyms);
+
+    // Take spare keys from the top, where layouts leave gaps
+    while (m_spareKeys.size() < MaxSpareKeys && !unused.empty()) {
+        m_spareKeys.push_back({unused.back(), NoKeySym, 0});
+        unused.pop_back();
+    }
+
+    m_shiftKeycode = XKeysymToKeycode(display, XK_Shift_L);
+    return true;
+}
+
+void KeyTyper::typeBatch()
+{
+    Display *display = X11Connection::instance().display();
+    ++m_batch;
+
+    int typed = 0;
+    while (m_position < m_keysyms.size() && typed < m_batchSize) {
+        KeyStroke stroke;
+        if (!strokeFor(m_keysyms[m_position], stroke)) {
+            if (typed > 0) {
+                break; // every spare key is in use; continue next batch
+            }
+            qDebug() << "[clip-template] No keycode for keysym"
+                     << QString::number(m_keysyms[m_position], 16) << "; skipped.";
+            ++m_position;
+            continue;
+        }
+
+        if (stroke.shift && m_shiftKeycode) {
+            XTestFakeKeyEvent(display, m_shiftKeycode, True, 0);
+        }
+        XTestFakeKeyEvent(display, stroke.keycode, True, 0);
+        XTestFakeKeyEvent(display, stroke.keycode, False, 0);
+        if (stroke.shift && m_shiftKeycode) {
+            XTestFakeKeyEvent(display, m_shiftKeycode, False, 0);
+        }
+        ++m_position;
+        ++typed;
+    }
+    XFlush(display);
+
+    if (m_position >= m_keysyms.size()) {
+        m_batchTimer.stop();
+        m_keysyms.clear();
+        m_restoreTimer.start();
+        emit finished();
+    }
+}
+
+bool KeyTyper::strokeFor(KeySym keysym, KeyStroke &stroke)
+{
+    auto it = m_keymap.find(keysym);
+    if (it != m_keymap.end()) {
+        stroke = it->second;
+        return true;
+    }
+
+    // Already on a spare key?
+    SpareKey *oldest = nullptr;
+    for (auto &spare : m_spareKeys) {
+        if (spare.keysym == keysym) {
+            spare.lastBatch = m_batch;
+            stroke = {spare.keycode, false};
+            return true;
+        }
+        if (spare.lastBatch < m_batch && (!oldest || spare.lastBatch < oldest->lastBatch)) {
+            oldest = &spare;
+        }
+    }
+
+    // Remapping a key typed in this batch would change it under the
+    // events still queued for the target
+    if (!oldest) {
+        return false;
+    }
+
+    KeySym mapping[] = {keysym, keysym};
+    XChangeKeyboardMapping(X11Connection::instance().display(), oldest->keycode, 2, mapping, 1);
+    oldest->keysym = keysym;
+    oldest->lastBatch = m_batch;
+    stroke = {oldest->keycode, false};
+    return true;
+}
+
+void KeyTyper::restoreSpareKeys()
+{
+    Display *display = X11Connection::instance().display();
+    if (!display || isTyping()) {
+        return;
+    }
+
+    bool changed = false;
+    for (auto &spare : m_spareKeys) {
+        if (spare.keysym == NoKeySym) {
+            continue;
+        }
+        KeySym mapping[] = {NoKeySym, NoKeySym};
+        XChangeKeyboardMapping(display, spare.keycode, 2, mapping, 1);
+        spare.keysym = NoKeySym;
+        changed = true;
+    }
+    if (changed) {
+        XFlush(display);
+    }
+}
+
+KeySym KeyTyper::keysymFor(uint codepoint)
+{
+    switch (codepoint) {
+    case '\n':
+        return XK_Return;
+    case '\t':
+        return XK_Tab;
+    default:
+        break;
+    }
+
+    // Control characters (including the '\r' of "\r\n") are not typed
+    if (codepoint < 0x20 || (codepoint >= 0x7F && codepoint < 0xA0)) {
+        return NoKeySym;
+    }
+    // Latin-1 keysyms equal their code points; the rest use the Unicode range
+    if (codepoint <= 0xFF) {
+        return codepoint;
+    }
+    return 0x01000000 | codepoint;
+}
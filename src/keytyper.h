@@ -0,0 +1,73 @@
+#ifndef KEYTYPER_H
+#define KEYTYPER_H
+
+#include <QObject>
+#include <QTimer>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "x11connection.h"
+
+typedef XID KeySym;
+
+// Types text into the focused window with XTest key events, for targets
+// that ignore Ctrl+V.
+//
+// Characters missing from the keymap (kana, kanji, symbols) are typed
+// by temporarily mapping them onto unused keycodes, which are reused
+// least recently used first and cleared once typing ends. Events are
+// sent in batches with one flush per batch, one batch per interval.
+class KeyTyper : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit KeyTyper(QObject *parent = nullptr);
+    ~KeyTyper();
+
+    // Characters per batch, and the pause between batches
+    void setBatchSize(int characters);
+    void setBatchInterval(int msecs);
+
+    // False when there is no X connection; finished() follows otherwise
+    bool type(const std::string &text);
+    bool isTyping() const { return m_batchTimer.isActive(); }
+    // Spare keys stay mapped a little after finished(), for the target
+    // to handle the last keys; keymapRestored() follows
+    bool isRestorePending() const { return m_restoreTimer.isActive(); }
+
+signals:
+    void finished();
+    void keymapRestored();
+
+private:
+    struct KeyStroke {
+        KeyCode keycode;
+        bool shift;
+    };
+
+    struct SpareKey {
+        KeyCode keycode;
+        KeySym keysym;      // 0 while unassigned
+        uint64_t lastBatch; // batch that last typed it
+    };
+
+    bool loadKeymap();
+    void typeBatch();
+    bool strokeFor(KeySym keysym, KeyStroke &stroke);
+    void restoreSpareKeys();
+    static KeySym keysymFor(uint codepoint);
+
+    std::vector<KeySym> m_keysyms;
+    size_t m_position;
+    std::unordered_map<KeySym, KeyStroke> m_keymap;
+    std::vector<SpareKey> m_spareKeys;
+    KeyCode m_shiftKeycode;
+    uint64_t m_batch;
+    int m_batchSize;
+    QTimer m_batchTimer;
+    QTimer m_restoreTimer;
+};
+
+#endif // KEYTYPER_H
@@ -1,8 +1,11 @@
 #include <QApplication>
+#include <QCoreApplication>
 #include <QFile>
 #include <QDir>
 #include <iostream>
 #include "mainwindow.h"
+#include "singleinstance.h"
+#include "trace.h"
 
 void ensureConfigExists()
 {
@@ -22,16 +25,64 @@ void ensureConfigExists()
 
 int main(int argc, char *argv[])
 {
+    Trace::enableFromArguments(argc, argv);
+
+    bool daemonMode = false;
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--daemon") == 0) {
+            daemonMode = true;
+        }
+    }
+
+    if (!daemonMode) {
+        // Let a resident instance show its popup; this skips building
+        // QApplication, the window and the template list entirely.
+        const int64_t probeBegin = Trace::now();
+        QCoreApplication probe(argc, argv);
+        const bool handedOver = SingleInstance::activateRunningInstance();
+        Trace::span("activateRunningInstance", probeBegin, Trace::now(), handedOver ? "daemon running" : "");
+        if (handedOver) {
+            Trace::write();
+            return 0;
+        }
+    }
+
+    int64_t begin = Trace::now();
     QApplication app(argc, argv);
+    Trace::span("QApplication", begin, Trace::now());
     app.setApplicationName("clip-template");
     app.setOrganizationName("ClipTemplate");
     
     // Ensure config exists
+    begin = Trace::now();
     ensureConfigExists();
+    Trace::span("ensureConfigExists", begin, Trace::now());
     
-    // Create and show main window
+    // Create main window (templates are loaded here)
+    begin = Trace::now();
     MainWindow window;
+    Trace::span("MainWindow", begin, Trace::now());
+
+    if (daemonMode) {
+        SingleInstance instance;
+        if (!instance.listen()) {
+            std::cerr << "clip-template: another daemon is already running" << std::endl;
+            return 1;
+        }
+
+        // Stay resident with the window hidden until activated
+        app.setQuitOnLastWindowClosed(false);
+        window.setResident(true);
+        QObject::connect(&instance, &SingleInstance::activationRequested,
+                         &window, &MainWindow::activate);
+        const int result = app.exec();
+        Trace::write();
+        return result;
+    }
+
     window.show();
     
-    return app.exec();
-}
\ No newline at end of file
+    const int result = app.exec();
+    Trace::write();
+    return result;
+}
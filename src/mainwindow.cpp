@@ -1,5 +1,17 @@
 #include "mainwindow.h"
 #include "keyboardhandler.h"
+#include "x11connection.h"
+#include "pastesequencer.h"
+#include "clipboardsnapshot.h"
+#include "keytyper.h"
+#include "templatediff.h"
+#include "templateloader.h"
+#include "templateitemdelegate.h"
+#include "templatepreview.h"
+#include "usagelog.h"
+#include "placeholders.h"
+#include "trace.h"
+#include <QHBoxLayout>
 #include <QKeyEvent>
 #include <QShowEvent>
 #include <QApplication>
@@ -8,6 +20,11 @@
 #include <QClipboard>
 #include <QMimeData>
 #include <QDebug>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QScrollBar>
+#include <algorithm>
+#include <numeric>
 
 // X11 headers must be included after Qt headers to avoid conflicts
 #include <X11/Xlib.h>
@@ -22,29 +39,115 @@ MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , m_templateManager(std::make_unique<TemplateManager>())
     , m_clipboardHandler(std::make_unique<ClipboardHandler>())
+    , m_searchWorker(std::make_unique<SearchWorker>())
     , m_previousWindow(0)
+    , m_usageLog(std::make_unique<UsageLog>())
 {
+    connect(m_searchWorker.get(), &SearchWorker::resultsReady, this, &MainWindow::onSearchResults);
+
+    m_pasteSequencer = new PasteSequencer(m_clipboardHandler.get(), this);
+    connect(m_pasteSequencer, &PasteSequencer::finished, this, &MainWindow::onPasteFinished);
+    connect(m_pasteSequencer, &PasteSequencer::aboutToPaste, this, [this]() {
+        // The previous owner stops answering once we take the clipboard:
+        // keep what the snapshot has so far
+        m_clipboardSnapshot->finish();
+        takeOverClipboard();
+    });
+
+    m_clipboardSnapshot = new ClipboardSnapshot(this);
+    connect(m_clipboardSnapshot, &ClipboardSnapshot::captured, this, &MainWindow::onClipboardCaptured);
+
+    // Editors often write a file several times per save; reload once
+    m_configWatcher = new QFileSystemWatcher(this);
+    m_reloadTimer = new QTimer(this);
+    m_reloadTimer->setSingleShot(true);
+    m_reloadTimer->setInterval(150);
+    connect(m_reloadTimer, &QTimer::timeout, this, &MainWindow::reloadTemplates);
+    connect(m_configWatcher, &QFileSystemWatcher::fileChanged, m_reloadTimer, QOverload<>::of(&QTimer::start));
+    connect(m_configWatcher, &QFileSystemWatcher::directoryChanged, m_reloadTimer, QOverload<>::of(&QTimer::start));
+
+    m_templateLoader = new TemplateLoader(m_templateManager.get(), this);
+    connect(m_templateLoader, &TemplateLoader::templatesAvailable, this, &MainWindow::onTemplatesAvailable);
+    connect(m_templateLoader, &TemplateLoader::finished, this, &MainWindow::onTemplatesLoadFinished);
+    connect(m_templateLoader, &TemplateLoader::reloaded, this, &MainWindow::onTemplatesReloaded);
+
     setupUI();
     setupShortcuts();
+    applySettings();
+    {
+        TraceScope trace("UsageLog::load");
+        m_usageLog->load();
+    }
     loadTemplates();
     rememberActiveWindow();
 
     // Setup clipboard monitoring and quit timer (for safe restoration on X11 without managers)
     m_quitTimer = new QTimer(this);
     m_quitTimer->setSingleShot(true);
-    connect(m_quitTimer, &QTimer::timeout, []() {
+    connect(m_quitTimer, &QTimer::timeout, [this]() {
         qDebug() << "[clip-template] Quit timer elapsed; exiting.";
-        QApplication::quit();
+        finishSession();
     });
 
     QClipboard *cb = QApplication::clipboard();
     connect(cb, &QClipboard::changed, this, &MainWindow::onClipboardChanged);
 }
 
-MainWindow::~MainWindow() = default;
+MainWindow::~MainWindow()
+{
+    // The loader's thread uses m_templateManager, which goes away first
+    m_templateLoader->cancel();
+}
+
+void MainWindow::setResident(bool resident)
+{
+    m_resident = resident;
+}
+
+void MainWindow::activate()
+{
+    TraceScope trace("MainWindow::activate");
+    // Drop any pending state from the previous session
+    m_quitTimer->stop();
+    m_monitorClipboard = false;
+    m_ignoreNextClipboardChange = false;
+
+    rememberActiveWindow();
+    m_searchBox->clear();
+    if (m_templateModel->rowCount() > 0) {
+        m_templateList->setCurrentIndex(m_templateModel->index(0));
+    }
+
+    show();
+    raise();
+    activateWindow();
+}
+
+void MainWindow::finishSession()
+{
+    if (!m_resident) {
+        // Quitting now would unmap the typed keys before the target read
+        // the last of them
+        KeyTyper *keyTyper = m_pasteSequencer->keyTyper();
+        if (keyTyper->isRestorePending()) {
+            connect(keyTyper, &KeyTyper::keymapRestored, qApp, &QApplication::quit);
+            return;
+        }
+        QApplication::quit();
+        return;
+    }
+
+    // Resident process keeps owning the restored clipboard, so there is
+    // nothing to wait for; just go back to the hidden state.
+    m_quitTimer->stop();
+    m_monitorClipboard = false;
+    hide();
+    Trace::write(); // the daemon may never exit normally
+}
 
 void MainWindow::setupUI()
 {
+    TraceScope trace("MainWindow::setupUI");
     // Create central widget
     QWidget *centralWidget = new QWidget(this);
     setCentralWidget(centralWidget);
@@ -58,11 +161,33 @@ void MainWindow::setupUI()
     connect(m_searchBox, &QLineEdit::textChanged, this, &MainWindow::onSearchTextChanged);
     layout->addWidget(m_searchBox);
     
-    // Create template list
-    m_templateList = new QListWidget(this);
+    // Create template list; uniform rows let the view lay out without
+    // asking the model for every item
+    m_templateModel = new TemplateListModel(this);
+    m_templateList = new QListView(this);
+    m_templateList->setModel(m_templateModel);
+    m_templateList->setUniformItemSizes(true);
+    // Rows are painted by the delegate, not the style sheet
+    m_templateList->setItemDelegate(new TemplateItemDelegate(m_templateModel, m_templateList));
+    m_templateList->viewport()->setAttribute(Qt::WA_Hover);
+    m_templateList->setEditTriggers(QAbstractItemView::NoEditTriggers);
     m_templateList->setFocusPolicy(Qt::StrongFocus);
-    connect(m_templateList, &QListWidget::itemActivated, this, &MainWindow::onItemActivated);
-    layout->addWidget(m_templateList);
+    connect(m_templateList, &QListView::activated, this, &MainWindow::onItemActivated);
+
+    // Content of the selected template beside the list; held arrow keys
+    // only update it once they pause
+    m_preview = new TemplatePreview(this);
+    m_previewTimer = new QTimer(this);
+    m_previewTimer->setSingleShot(true);
+    m_previewTimer->setInterval(80);
+    connect(m_previewTimer, &QTimer::timeout, this, &MainWindow::updatePreview);
+    connect(m_templateList->selectionModel(), &QItemSelectionModel::currentChanged,
+            this, &MainWindow::onCurrentTemplateChanged);
+
+    QHBoxLayout *listLayout = new QHBoxLayout();
+    listLayout->addWidget(m_templateList, 1);
+    listLayout->addWidget(m_preview, 1);
+    layout->addLayout(listLayout);
     
     // Window settings
     setWindowTitle("Template Selector");
@@ -70,7 +195,7 @@ void MainWindow::setupUI()
     setAttribute(Qt::WA_TranslucentBackground);
     
     // Set window size and position
-    resize(400, 500);
+    resize(760, 500);
     QRect screenGeometry = QApplication::desktop()->screenGeometry();
     int x = (screenGeometry.width() - width()) / 2;
     int y = (screenGeometry.height() - height()) / 2;
@@ -91,7 +216,7 @@ void MainWindow::setupUI()
             padding: 8px;
             font-size: 14px;
         }
-        QListWidget {
+        QListView {
             background-color: rgba(40, 40, 40, 255);
             color: white;
             border: none;
@@ -99,21 +224,19 @@ void MainWindow::setupUI()
             padding: 4px;
             font-size: 14px;
         }
-        QListWidget::item {
-            padding: 8px;
+        TemplatePreview {
+            background-color: rgba(40, 40, 40, 255);
+            color: #dddddd;
+            border: none;
             border-radius: 4px;
-        }
-        QListWidget::item:selected {
-            background-color: #3daee9;
-        }
-        QListWidget::item:hover {
-            background-color: rgba(61, 174, 233, 100);
+            font-size: 13px;
         }
     )");
 }
 
 void MainWindow::setupShortcuts()
 {
+    TraceScope trace("MainWindow::setupShortcuts");
     // Escape to quit
     QShortcut *escShortcut = new QShortcut(QKeySequence(Qt::Key_Escape), this);
     connect(escShortcut, &QShortcut::activated, this, &MainWindow::onEscapePressed);
@@ -125,6 +248,25 @@ void MainWindow::setupShortcuts()
         m_searchBox->selectAll();
     });
     
+    // Shift+PageUp/PageDown scroll the preview
+    QShortcut *previewUpShortcut = new QShortcut(QKeySequence(Qt::SHIFT + Qt::Key_PageUp), this);
+    connect(previewUpShortcut, &QShortcut::activated, [this]() {
+        m_preview->verticalScrollBar()->triggerAction(QAbstractSlider::SliderPageStepSub);
+    });
+    QShortcut *previewDownShortcut = new QShortcut(QKeySequence(Qt::SHIFT + Qt::Key_PageDown), this);
+    connect(previewDownShortcut, &QShortcut::activated, [this]() {
+        m_preview->verticalScrollBar()->triggerAction(QAbstractSlider::SliderPageStepAdd);
+    });
+
+    // Ctrl+F switches between substring and fuzzy search
+    QShortcut *modeShortcut = new QShortcut(QKeySequence(Qt::CTRL + Qt::Key_F), this);
+    connect(modeShortcut, &QShortcut::activated, [this]() {
+        setSearchMode(m_searchWorker->mode() == TemplateSearch::Mode::Fuzzy
+                          ? TemplateSearch::Mode::Substring
+                          : TemplateSearch::Mode::Fuzzy);
+        filterTemplates(m_searchBox->text());
+    });
+    
     // Number keys for quick selection
     for (int i = 1; i <= 9; ++i) {
         QShortcut *numShortcut = new QShortcut(QKeySequence(Qt::Key_0 + i), this);
@@ -136,111 +278,383 @@ void MainWindow::setupShortcuts()
 
 void MainWindow::loadTemplates()
 {
-    m_templates = m_templateManager->loadTemplates();
-    m_filteredTemplates = m_templates;
-    
-    m_templateList->clear();
-    for (const auto &tmpl : m_filteredTemplates) {
-        QString displayText = QString("[%1] %2").arg(tmpl.shortcut).arg(QString::fromStdString(tmpl.name));
-        if (!tmpl.category.empty()) {
-            displayText = QString("[%1] %2 (%3)").arg(tmpl.shortcut).arg(QString::fromStdString(tmpl.name)).arg(QString::fromStdString(tmpl.category));
-        }
-        m_templateList->addItem(displayText);
+    TraceScope trace("MainWindow::loadTemplates");
+    const std::vector<std::string> sources = m_templateManager->configSources();
+    m_searchWorker->cancelAndWait(); // the store is about to be refilled
+    m_preview->reset();
+    if (m_templateManager->loadCachedTemplates(sources, m_templates)) {
+        showTemplates();
+    } else {
+        // Parse in the background; rows appear as batches arrive
+        setTemplates(std::vector<Template>());
+        m_templateLoader->start(sources);
     }
-    
-    if (m_templateList->count() > 0) {
-        m_templateList->setCurrentRow(0);
+    watchConfig();
+}
+
+void MainWindow::onTemplatesAvailable()
+{
+    TraceScope trace("MainWindow::onTemplatesAvailable");
+    std::vector<Template> batch = m_templateLoader->takeLoaded();
+    if (batch.empty()) {
+        return;
     }
+
+    keepSelectionForNextResults();
+    const uint32_t first = static_cast<uint32_t>(m_templates.size());
+    m_searchWorker->appendTemplates(m_templates, batch);
+    m_templateOrder.resize(m_templates.size());
+    std::iota(m_templateOrder.begin() + first, m_templateOrder.end(), first);
+    refreshBoosts(first);
+
+    // Searching the partial set keeps the current query's rows current
+    filterTemplates(m_searchBox->text());
 }
 
-void MainWindow::filterTemplates(const QString &filter)
+void MainWindow::onTemplatesLoadFinished(bool complete)
 {
-    m_filteredTemplates.clear();
-    QString lowerFilter = filter.toLower();
-    
-    for (const auto &tmpl : m_templates) {
-        QString name = QString::fromStdString(tmpl.name).toLower();
-        QString category = QString::fromStdString(tmpl.category).toLower();
-        QString content = QString::fromStdString(tmpl.content).toLower();
-        
-        if (name.contains(lowerFilter) || 
-            category.contains(lowerFilter) || 
-            content.contains(lowerFilter)) {
-            m_filteredTemplates.push_back(tmpl);
-        }
+    qDebug() << "[clip-template] Loaded" << (int)m_templates.size() << "templates" << (complete ? "." : "(incomplete).");
+    if (m_reloadAfterLoad) {
+        m_reloadAfterLoad = false;
+        m_reloadTimer->start();
     }
+}
+
+void MainWindow::keepSelectionForNextResults()
+{
+    m_reloadPending = true;
+    m_reloadSelection = m_templateModel->templateId(m_templateList->currentIndex().row());
+    m_reloadScroll = m_templateList->verticalScrollBar()->value();
+}
+
+void MainWindow::setTemplates(std::vector<Template> templates)
+{
+    m_searchWorker->cancelAndWait(); // the store is about to be rebuilt
+    m_preview->reset();              // and with it the previewed text
+    m_templates.assign(std::move(templates));
+    showTemplates();
+}
+
+void MainWindow::showTemplates()
+{
+    m_templateOrder.resize(m_templates.size());
+    std::iota(m_templateOrder.begin(), m_templateOrder.end(), 0u);
+    m_searchWorker->setTemplates(m_templates);
+    refreshBoosts(0);
+    m_templateModel->setTemplates(m_templates);
     
-    m_templateList->clear();
-    for (const auto &tmpl : m_filteredTemplates) {
-        QString displayText = QString("[%1] %2").arg(tmpl.shortcut).arg(QString::fromStdString(tmpl.name));
-        if (!tmpl.category.empty()) {
-            displayText = QString("[%1] %2 (%3)").arg(tmpl.shortcut).arg(QString::fromStdString(tmpl.name)).arg(QString::fromStdString(tmpl.category));
+    if (m_templateModel->rowCount() > 0) {
+        m_templateList->setCurrentIndex(m_templateModel->index(0));
+    }
+}
+
+void MainWindow::watchConfig()
+{
+    // Saving by rename drops the watch on a file, so the watches are
+    // added again after every reload; the directories catch new files
+    QStringList paths;
+    for (const auto &source : m_templateManager->configSources()) {
+        paths.append(QString::fromStdString(source));
+    }
+    for (const auto &directory : m_templateManager->configDirectories()) {
+        paths.append(QString::fromStdString(directory));
+    }
+    const QString journal = QString::fromStdString(m_templateManager->journalPath());
+    if (QFile::exists(journal)) {
+        paths.append(journal); // edits append to it
+    }
+
+    const QStringList watched = m_configWatcher->files() + m_configWatcher->directories();
+    for (const QString &path : paths) {
+        if (!watched.contains(path)) {
+            m_configWatcher->addPath(path);
         }
-        m_templateList->addItem(displayText);
     }
-    
-    if (m_templateList->count() > 0) {
-        m_templateList->setCurrentRow(0);
+}
+
+void MainWindow::reloadTemplates()
+{
+    TraceScope trace("MainWindow::reloadTemplates");
+    // The diff needs the complete current set
+    if (m_templateLoader->isLoading()) {
+        m_reloadAfterLoad = true;
+        return;
     }
+
+    // Parsed in the background; the popup stays responsive meanwhile
+    m_templateLoader->reload(m_templateManager->configSources());
+}
+
+void MainWindow::onTemplatesReloaded(bool complete)
+{
+    TraceScope trace("MainWindow::onTemplatesReloaded");
+    std::vector<Template> incoming = m_templateLoader->takeLoaded();
+    watchConfig();
+    if (m_reloadAfterLoad) {
+        // Changed again while it was read
+        m_reloadAfterLoad = false;
+        m_reloadTimer->start();
+        return;
+    }
+    if (!complete) {
+        return; // a partial set would look like removed templates
+    }
+
+    TemplateDiff diff = TemplateDiff::compute(m_templates, m_templateOrder, incoming);
+    if (diff.isEmpty()) {
+        return;
+    }
+    qDebug() << "[clip-template] Templates reloaded:" << (int)diff.added.size() << "added,"
+             << (int)diff.updated.size() << "updated," << (int)diff.removed.size() << "removed.";
+
+    keepSelectionForNextResults();
+
+    // Compact once emptied slots would outnumber the live ones, or text
+    // left behind by updates would fill half the arena
+    const size_t slots = m_templates.size() + diff.added.size();
+    if (slots - diff.order.size() > diff.order.size() || m_templates.garbageSize() > m_templates.arenaSize() / 2) {
+        setTemplates(std::move(incoming));
+        m_reloadSelection = TemplateListModel::NoTemplate;
+    } else {
+        m_searchWorker->applyDiff(m_templates, diff, incoming);
+        m_templateOrder = std::move(diff.order);
+        refreshBoosts(0);
+        updatePreview(); // the selected template may have changed
+    }
+
+    // The results of the current query replace the rows; see onSearchResults
+    filterTemplates(m_searchBox->text());
+}
+
+void MainWindow::refreshBoosts(uint32_t first)
+{
+    if (m_usageLog->isEmpty() && m_boosts.empty()) {
+        return; // nothing was ever pasted; plain file order
+    }
+
+    // Slots from first on are new; emptied slots never match anyway
+    m_boosts.resize(m_templates.size(), 0);
+    for (uint32_t id = first; id < m_templates.size(); ++id) {
+        m_boosts[id] = m_templates.isRemoved(id) ? 0 : m_usageLog->boost(usageKey(id));
+    }
+    m_searchWorker->setBoosts(m_boosts);
+}
+
+void MainWindow::recordUsage()
+{
+    const uint32_t id = m_pendingUsage;
+    m_pendingUsage = TemplateListModel::NoTemplate;
+    if (id >= m_templates.size() || m_templates.isRemoved(id)) {
+        return; // removed by a reload while pasting
+    }
+
+    const uint64_t key = usageKey(id);
+    m_usageLog->record(key);
+    if (m_boosts.size() < m_templates.size()) {
+        m_boosts.resize(m_templates.size(), 0);
+    }
+    m_boosts[id] = m_usageLog->boost(key);
+    m_searchWorker->setBoost(id, m_boosts[id]);
+    filterTemplates(m_searchBox->text());
+}
+
+uint64_t MainWindow::usageKey(uint32_t id) const
+{
+    return UsageLog::keyOf(m_templates.name(id), m_templates.category(id));
+}
+
+void MainWindow::applySettings()
+{
+    TraceScope trace("MainWindow::applySettings");
+    m_settings = m_templateManager->loadSettings();
+    m_pasteSequencer->setFocusTimeout(m_settings.focusTimeout);
+    m_pasteSequencer->setTransferTimeout(m_settings.transferTimeout);
+    m_pasteSequencer->keyTyper()->setBatchSize(m_settings.typeBatchSize);
+    m_pasteSequencer->keyTyper()->setBatchInterval(m_settings.typeBatchInterval);
+    m_clipboardSnapshot->setByteLimit(m_settings.snapshotMaxBytes);
+    m_clipboardSnapshot->setTimeout(m_settings.snapshotTimeout);
+    QStringList snapshotFormats;
+    for (const auto &format : m_settings.snapshotFormats) {
+        snapshotFormats.append(QString::fromStdString(format));
+    }
+    m_clipboardSnapshot->setAllowedFormats(snapshotFormats);
+    m_searchWorker->setFuzzyResultLimit(static_cast<size_t>(std::max(1, m_settings.fuzzyResultLimit)));
+    setSearchMode(m_settings.searchMode == "fuzzy" ? TemplateSearch::Mode::Fuzzy : TemplateSearch::Mode::Substring);
+}
+
+void MainWindow::setSearchMode(TemplateSearch::Mode mode)
+{
+    m_searchWorker->setMode(mode);
+    if (mode == TemplateSearch::Mode::Fuzzy) {
+        m_searchBox->setPlaceholderText("あいまい検索 (/ キーでフォーカス, Ctrl+F で切替)...");
+    } else {
+        m_searchBox->setPlaceholderText("検索 (/ キーでフォーカス, Ctrl+F で切替)...");
+    }
+}
+
+void MainWindow::filterTemplates(const QString &filter)
+{
+    // Runs on the search worker; results arrive in onSearchResults
+    m_searchWorker->search(filter);
+}
+
+void MainWindow::onCurrentTemplateChanged()
+{
+    // The first change shows at once; while changes come faster than the
+    // timer (held arrow keys), only the last one is shown
+    if (!m_previewTimer->isActive()) {
+        updatePreview();
+    }
+    m_previewTimer->start();
+}
+
+void MainWindow::updatePreview()
+{
+    TraceScope trace("MainWindow::updatePreview");
+    const uint32_t id = m_templateModel->templateId(m_templateList->currentIndex().row());
+    m_preview->setContent(id == TemplateListModel::NoTemplate ? std::string_view() : m_templates.content(id));
 }
 
 void MainWindow::copyAndPaste()
 {
-    int currentRow = m_templateList->currentRow();
-    if (currentRow >= 0 && currentRow < static_cast<int>(m_filteredTemplates.size())) {
-        const Template &tmpl = m_filteredTemplates[currentRow];
+    TraceScope trace("MainWindow::copyAndPaste");
+    const uint32_t id = m_templateModel->templateId(m_templateList->currentIndex().row());
+    if (id == TemplateListModel::NoTemplate || m_clipboardSnapshot->isCapturing() || m_pasteStarted) {
+        return;
+    }
+    // Only what the expansion needs; the slot may change before it runs
+    m_pendingTemplate = m_templates.pasteTemplate(id);
+    m_pendingUsage = id;
+    m_tracePaste = Trace::isEnabled() ? Trace::now() : -1;
 
-        // Remember current clipboard data to restore later
-        QClipboard *clipboard = QApplication::clipboard();
-        const QMimeData *orig = clipboard->mimeData(QClipboard::Clipboard);
-        if (m_savedClipboardData) {
-            delete m_savedClipboardData;
-            m_savedClipboardData = nullptr;
-        }
-        if (orig) {
-            m_savedClipboardData = new QMimeData();
-            const QStringList formats = orig->formats();
-            for (const QString &fmt : formats) {
-                m_savedClipboardData->setData(fmt, orig->data(fmt));
-            }
-            qDebug() << "[clip-template] Saved clipboard formats:" << formats;
-        } else {
-            qDebug() << "[clip-template] No original clipboard data present.";
-        }
+    // Hide window
+    hide();
 
-        // Copy to clipboard
-        m_clipboardHandler->copyToClipboard(tmpl.content);
-        qDebug() << "[clip-template] Set clipboard to template (length)" << (int)tmpl.content.size();
-
-        // Hide window
-        hide();
-
-        // Restore focus to previous window and paste
-        QTimer::singleShot(100, [this]() {
-            m_clipboardHandler->pasteToWindow(m_previousWindow);
-            // After paste keystrokes are sent, restore clipboard data shortly after
-            QTimer::singleShot(150, [this]() {
-                QClipboard *cb = QApplication::clipboard();
-                if (m_savedClipboardData) {
-                    m_ignoreNextClipboardChange = true; // ignore our own change signal
-                    qDebug() << "[clip-template] Restoring previous clipboard data.";
-                    cb->setMimeData(m_savedClipboardData, QClipboard::Clipboard); // ownership transferred
-                    m_savedClipboardData = nullptr;
-                    // Monitor for changes and quit when someone else takes over, or timeout
-                    m_monitorClipboard = true;
-                    m_quitTimer->start(10000); // 10s safety timeout
-                } else {
-                    qDebug() << "[clip-template] No saved clipboard data to restore; exiting.";
-                    QApplication::quit();
+    if (m_settings.pasteMode == "type") {
+        // The clipboard is left alone; the text is typed as key events
+        QTimer::singleShot(0, this, [this]() {
+            int cursorBack = 0;
+            const std::string text = Placeholders::expand(m_pendingTemplate, [this]() {
+                if (m_clipboardHandler->ownsClipboard()) {
+                    return m_clipboardHandler->clipboardText();
                 }
-            });
+                return QApplication::clipboard()->text().toStdString();
+            }, &cursorBack);
+            m_pendingTemplate = Template();
+            m_pasteSequencer->startTyping(m_previousWindow, text, cursorBack);
         });
+        return;
+    }
+
+    // Remember current clipboard data to restore later
+    if (m_savedClipboardData) {
+        delete m_savedClipboardData;
+        m_savedClipboardData = nullptr;
+    }
+    if (m_clipboardHandler->ownsClipboard()) {
+        // Still holding an earlier paste; no need to ask the X server
+        QMimeData *data = new QMimeData();
+        data->setText(QString::fromStdString(m_clipboardHandler->clipboardText()));
+        qDebug() << "[clip-template] Saved our own clipboard text.";
+        onClipboardCaptured(data);
+    } else if (Placeholders::usesClipboard(m_pendingTemplate)) {
+        // {{clipboard}} needs the old text before anything is pasted
+        m_clipboardSnapshot->capture();
+    } else {
+        // The snapshot is taken while the target gets the focus back; the
+        // paste never waits for it
+        startPaste();
+        m_clipboardSnapshot->capture();
+    }
+}
+
+void MainWindow::onClipboardCaptured(QMimeData *data)
+{
+    TraceScope trace("MainWindow::onClipboardCaptured");
+    m_savedClipboardData = data;
+    if (data) {
+        qDebug() << "[clip-template] Saved clipboard formats:" << data->formats();
+    } else {
+        qDebug() << "[clip-template] No original clipboard data present.";
+    }
+
+    if (!m_pasteStarted) {
+        startPaste();
+    }
+    takeOverClipboard();
+}
+
+void MainWindow::startPaste()
+{
+    // {{clipboard}} comes from the snapshot, when one was waited for
+    int cursorBack = 0;
+    m_pendingText = Placeholders::expand(m_pendingTemplate, [this]() {
+        return m_savedClipboardData ? m_savedClipboardData->text().toStdString() : std::string();
+    }, &cursorBack);
+    m_pendingTemplate = Template();
+    m_textPending = true;
+    m_pasteStarted = true;
+
+    // Restore focus to previous window and paste once Qt has flushed
+    // the unmap; onPasteFinished restores the clipboard afterwards
+    QTimer::singleShot(0, this, [this, cursorBack]() {
+        m_pasteSequencer->start(m_previousWindow, cursorBack);
+    });
+}
+
+void MainWindow::takeOverClipboard()
+{
+    // Once the snapshot is complete or right before Ctrl+V, whichever
+    // comes first
+    if (!m_textPending) {
+        return;
+    }
+    m_textPending = false;
+    m_clipboardHandler->copyToClipboard(m_pendingText);
+    qDebug() << "[clip-template] Set clipboard to template (length)" << (int)m_pendingText.size();
+    m_pendingText.clear();
+}
+
+void MainWindow::onPasteFinished(bool transferred)
+{
+    qDebug() << "[clip-template] Paste finished; target fetched clipboard:" << transferred;
+
+    // A paste that never got to Ctrl+V still ends the snapshot
+    m_textPending = false;
+    m_pendingText.clear();
+    m_clipboardSnapshot->finish();
+    m_pasteStarted = false;
+
+    if (m_tracePaste >= 0) {
+        Trace::span("paste", m_tracePaste, Trace::now(), transferred ? "transferred" : "timed out");
+        m_tracePaste = -1;
+    }
+
+    // Recorded once the paste is done, so it never delays it
+    recordUsage();
+
+    QClipboard *cb = QApplication::clipboard();
+    if (m_savedClipboardData) {
+        m_ignoreNextClipboardChange = true; // ignore our own change signal
+        qDebug() << "[clip-template] Restoring previous clipboard data.";
+        cb->setMimeData(m_savedClipboardData, QClipboard::Clipboard); // ownership transferred
+        m_savedClipboardData = nullptr;
+        if (m_resident) {
+            finishSession();
+            return;
+        }
+        // Monitor for changes and quit when someone else takes over, or timeout
+        m_monitorClipboard = true;
+        m_quitTimer->start(10000); // 10s safety timeout
+    } else {
+        qDebug() << "[clip-template] No saved clipboard data to restore; exiting.";
+        finishSession();
     }
 }
 
 void MainWindow::rememberActiveWindow()
 {
-    Display *display = XOpenDisplay(nullptr);
+    Display *display = X11Connection::instance().display();
     if (display) {
         Window focusWindow;
         int revertTo;
@@ -249,8 +663,6 @@ void MainWindow::rememberActiveWindow()
         if (focusWindow != 0 && focusWindow != PointerRoot) {
             m_previousWindow = focusWindow;
         }
-        
-        XCloseDisplay(display);
     }
 }
 
@@ -283,30 +695,72 @@ void MainWindow::showEvent(QShowEvent *event)
 {
     QMainWindow::showEvent(event);
     m_templateList->setFocus();
+    m_traceShown = Trace::isEnabled() ? Trace::now() : -1;
 }
 
-void MainWindow::onItemActivated(QListWidgetItem *item)
+void MainWindow::paintEvent(QPaintEvent *event)
 {
-    Q_UNUSED(item)
+    QMainWindow::paintEvent(event);
+    if (m_traceShown >= 0) {
+        Trace::span("show to first paint", m_traceShown, Trace::now());
+        m_traceShown = -1;
+    }
+}
+
+void MainWindow::onItemActivated(const QModelIndex &index)
+{
+    Q_UNUSED(index)
     copyAndPaste();
 }
 
 void MainWindow::onSearchTextChanged(const QString &text)
 {
+    m_reloadPending = false;
     filterTemplates(text);
 }
 
+void MainWindow::onSearchResults(quint64 generation, const std::vector<uint32_t> &results)
+{
+    TraceScope trace("MainWindow::onSearchResults");
+    // A newer query is already running; its results will replace these
+    if (generation != m_searchWorker->currentGeneration()) {
+        return;
+    }
+
+    if (m_reloadPending) {
+        // Keep the selection and scroll position across a reload or a
+        // streamed batch
+        m_reloadPending = false;
+        if (!m_templateModel->setRows(results)) {
+            m_templateModel->refresh();
+            return;
+        }
+        const int row = m_templateModel->rowOf(m_reloadSelection);
+        if (m_templateModel->rowCount() > 0) {
+            m_templateList->setCurrentIndex(m_templateModel->index(std::max(0, row)));
+        }
+        m_templateList->verticalScrollBar()->setValue(m_reloadScroll);
+        return;
+    }
+
+    m_templateModel->setRows(results);
+    if (m_templateModel->rowCount() > 0) {
+        m_templateList->setCurrentIndex(m_templateModel->index(0));
+    }
+}
+
 void MainWindow::onEscapePressed()
 {
-    QApplication::quit();
+    finishSession();
 }
 
 void MainWindow::handleNumberKey(int number)
 {
     // Find template with this shortcut
-    for (size_t i = 0; i < m_filteredTemplates.size(); ++i) {
-        if (m_filteredTemplates[i].shortcut == number) {
-            m_templateList->setCurrentRow(i);
+    const int rows = m_templateModel->rowCount();
+    for (int row = 0; row < rows; ++row) {
+        if (m_templates.shortcut(m_templateModel->templateId(row)) == number) {
+            m_templateList->setCurrentIndex(m_templateModel->index(row));
             copyAndPaste();
             break;
         }
@@ -325,5 +779,5 @@ void MainWindow::onClipboardChanged(QClipboard::Mode mode)
     }
 
     qDebug() << "[clip-template] Clipboard changed by external owner; exiting.";
-    QApplication::quit();
+    finishSession();
 }
@@ -2,7 +2,7 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QListWidget>
+#include <QListView>
 #include <QLineEdit>
 #include <QVBoxLayout>
 #include <QShortcut>
@@ -11,6 +11,16 @@
 #include <vector>
 #include "templatemanager.h"
 #include "clipboardhandler.h"
+#include "searchworker.h"
+#include "templatelistmodel.h"
+#include "templatestore.h"
+
+class PasteSequencer;
+class ClipboardSnapshot;
+class QFileSystemWatcher;
+class TemplateLoader;
+class TemplatePreview;
+class UsageLog;
 
 class MainWindow : public QMainWindow
 {
@@ -20,38 +30,98 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    // Resident (daemon) windows hide instead of quitting after each use
+    void setResident(bool resident);
+
+public slots:
+    void activate();
+
 protected:
     void keyPressEvent(QKeyEvent *event) override;
     void showEvent(QShowEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
 
 private slots:
-    void onItemActivated(QListWidgetItem *item);
+    void onItemActivated(const QModelIndex &index);
     void onSearchTextChanged(const QString &text);
     void onEscapePressed();
     void handleNumberKey(int number);
     void onClipboardChanged(QClipboard::Mode mode);
+    void onSearchResults(quint64 generation, const std::vector<uint32_t> &results);
+    void onClipboardCaptured(QMimeData *data);
+    void onPasteFinished(bool transferred);
+    void reloadTemplates();
+    void onTemplatesAvailable();
+    void onTemplatesLoadFinished(bool complete);
+    void onTemplatesReloaded(bool complete);
+    void onCurrentTemplateChanged();
 
 private:
     void setupUI();
     void setupShortcuts();
     void loadTemplates();
+    void setTemplates(std::vector<Template> templates);
+    // Searches and lists the templates now in m_templates
+    void showTemplates();
+    void watchConfig();
+    void keepSelectionForNextResults();
+    void refreshBoosts(uint32_t first);
+    void recordUsage();
+    uint64_t usageKey(uint32_t id) const;
+    void applySettings();
+    void setSearchMode(TemplateSearch::Mode mode);
     void filterTemplates(const QString &filter);
+    void updatePreview();
     void copyAndPaste();
+    void startPaste();
+    void takeOverClipboard();
     void rememberActiveWindow();
+    void finishSession();
     
-    QListWidget *m_templateList;
+    QListView *m_templateList;
+    TemplateListModel *m_templateModel;
     QLineEdit *m_searchBox;
+    TemplatePreview *m_preview;
+    QTimer *m_previewTimer;
     std::unique_ptr<TemplateManager> m_templateManager;
     std::unique_ptr<ClipboardHandler> m_clipboardHandler;
-    std::vector<Template> m_templates;
-    std::vector<Template> m_filteredTemplates;
+    TemplateStore m_templates;          // slots; see TemplateDiff
+    std::vector<uint32_t> m_templateOrder; // live slots in file order
+    // Declared after m_templates so it stops searching before they are destroyed
+    std::unique_ptr<SearchWorker> m_searchWorker;
+    Settings m_settings;
     Window m_previousWindow;
+    PasteSequencer *m_pasteSequencer;
+    ClipboardSnapshot *m_clipboardSnapshot;
+    Template m_pendingTemplate; // content and segments, until expanded
+    std::string m_pendingText;  // expanded, until it is put on the clipboard
+    bool m_textPending = false; // m_pendingText is still to be copied
+    bool m_pasteStarted = false; // the sequencer runs for the current paste
+
+    // Frecency ranking
+    std::unique_ptr<UsageLog> m_usageLog;
+    std::vector<int> m_boosts;         // per slot, see UsageLog::boost
+    uint32_t m_pendingUsage = TemplateListModel::NoTemplate; // slot being pasted
 
     // Clipboard restore support
     QMimeData *m_savedClipboardData = nullptr; // owned until restored via setMimeData
     bool m_monitorClipboard = false;
     bool m_ignoreNextClipboardChange = false;
     QTimer *m_quitTimer = nullptr;
+    bool m_resident = false;
+
+    // Hot reload of the active templates file
+    QFileSystemWatcher *m_configWatcher = nullptr;
+    QTimer *m_reloadTimer = nullptr;
+    TemplateLoader *m_templateLoader = nullptr;
+    bool m_reloadAfterLoad = false; // the file changed during a load or reload
+    bool m_reloadPending = false;   // next results come from a reload
+    uint32_t m_reloadSelection = 0; // template selected before it
+    int m_reloadScroll = 0;
+
+    // Trace::now() at the start of phases spanning events, or -1
+    int64_t m_traceShown = -1;
+    int64_t m_tracePaste = -1;
 };
 
 #endif // MAINWINDOW_H
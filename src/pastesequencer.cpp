@@ -0,0 +1,243 @@
+#include "pastesequencer.h"
+#include "clipboardhandler.h"
+#include "selectionowner.h"
+#include "keytyper.h"
+#include "trace.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <xcb/xcb.h>
+
+// X11 headers must be included after Qt headers
+#include <X11/Xlib.h>
+#undef None
+#undef KeyPress
+#undef KeyRelease
+#undef FocusIn
+#undef FocusOut
+
+namespace {
+const int XFocusInEvent = 9; // FocusIn, undefined above to avoid clashing with Qt
+const int DefaultFocusTimeout = 200;
+const int DefaultTransferTimeout = 1000;
+}
+
+PasteSequencer::PasteSequencer(ClipboardHandler *clipboardHandler, QObject *parent)
+    : QObject(parent)
+    , m_clipboardHandler(clipboardHandler)
+    , m_keyTyper(new KeyTyper(this))
+    , m_cursorBack(0)
+    , m_phaseBegin(0)
+    , m_state(State::Idle)
+    , m_target(0)
+    , m_watchingFocus(false)
+{
+    m_focusTimer.setSingleShot(true);
+    m_focusTimer.setInterval(DefaultFocusTimeout);
+    connect(&m_focusTimer, &QTimer::timeout, this, [this]() {
+        qDebug() << "[clip-template] No focus change seen; pasting anyway.";
+        sendPaste();
+    });
+
+    m_transferTimer.setSingleShot(true);
+    m_transferTimer.setInterval(DefaultTransferTimeout);
+    connect(&m_transferTimer, &QTimer::timeout, this, [this]() {
+        qDebug() << "[clip-template] No clipboard request seen; finishing anyway.";
+        finish(false);
+    });
+
+    // The native selection owner knows when its data has been delivered;
+    // the Qt event filter covers the QClipboard fallback
+    connect(m_clipboardHandler->selectionOwner(), &SelectionOwner::transferCompleted, this, [this]() {
+        if (m_state == State::WaitingForTransfer) {
+            finish(true);
+        }
+    });
+
+    connect(m_keyTyper, &KeyTyper::finished, this, [this]() {
+        if (m_state == State::Typing) {
+            finish(true);
+        }
+    });
+}
+
+PasteSequencer::~PasteSequencer()
+{
+    stopWatchingFocus();
+    if (QCoreApplication::instance()) {
+        QCoreApplication::instance()->removeNativeEventFilter(this);
+    }
+}
+
+void PasteSequencer::setFocusTimeout(int msecs)
+{
+    m_focusTimer.setInterval(msecs);
+}
+
+void PasteSequencer::setTransferTimeout(int msecs)
+{
+    m_transferTimer.setInterval(msecs);
+}
+
+void PasteSequencer::startTyping(Window target, const std::string &text, int cursorBack)
+{
+    m_typeText = text;
+    start(target, cursorBack);
+}
+
+void PasteSequencer::start(Window target, int cursorBack)
+{
+    m_phaseBegin = Trace::now();
+    Display *display = X11Connection::instance().display();
+    if (target == 0 || !display) {
+        // Nothing to paste into; still report completion asynchronously
+        m_state = State::WaitingForTransfer;
+        QTimer::singleShot(0, this, [this]() { finish(false); });
+        return;
+    }
+
+    m_target = target;
+    m_cursorBack = cursorBack;
+    m_state = State::WaitingForFocus;
+
+    X11Connection::instance().addEventHandler(this);
+    XSelectInput(display, target, FocusChangeMask);
+    XSelectInput(display, DefaultRootWindow(display), PropertyChangeMask);
+    m_watchingFocus = true;
+
+    m_clipboardHandler->setFocusToWindow(display, target);
+    m_focusTimer.start();
+
+    // The focus may already be there; this round trip also reads any
+    // events that arrived meanwhile
+    if (targetHasFocus()) {
+        sendPaste();
+        return;
+    }
+    X11Connection::instance().processPendingEvents();
+}
+
+bool PasteSequencer::x11Event(XEvent *event)
+{
+    if (m_state != State::WaitingForFocus) {
+        return false;
+    }
+
+    // Ignore the synthetic FocusIn that setFocusToWindow sends itself
+    if (event->type == XFocusInEvent && event->xfocus.window == m_target && !event->xfocus.send_event) {
+        sendPaste();
+    } else if (event->type == PropertyNotify &&
+               event->xproperty.atom == X11Connection::instance().atom(X11Connection::NetActiveWindow) &&
+               targetHasFocus()) {
+        sendPaste();
+    }
+
+    return false;
+}
+
+bool PasteSequencer::nativeEventFilter(const QByteArray &eventType, void *message, long *result)
+{
+    Q_UNUSED(result)
+    if (m_state != State::WaitingForTransfer || eventType != "xcb_generic_event_t") {
+        return false;
+    }
+
+    const xcb_generic_event_t *event = static_cast<xcb_generic_event_t *>(message);
+    if ((event->response_type & ~0x80) != XCB_SELECTION_REQUEST) {
+        return false;
+    }
+
+    // TARGETS and TIMESTAMP only probe the selection; wait for the data
+    const X11Connection &x11 = X11Connection::instance();
+    const auto *request = reinterpret_cast<const xcb_selection_request_event_t *>(event);
+    if (request->selection != x11.atom(X11Connection::Clipboard) ||
+        request->target == x11.atom(X11Connection::Targets) ||
+        request->target == x11.atom(X11Connection::Timestamp)) {
+        return false;
+    }
+
+    // Let Qt answer the request before the sequence is reported finished
+    QTimer::singleShot(0, this, [this]() { finish(true); });
+    return false;
+}
+
+bool PasteSequencer::targetHasFocus() const
+{
+    Display *display = X11Connection::instance().display();
+    Window focusWindow = 0;
+    int revertTo = 0;
+    XGetInputFocus(display, &focusWindow, &revertTo);
+    return focusWindow == m_target;
+}
+
+void PasteSequencer::sendPaste()
+{
+    if (m_state != State::WaitingForFocus) {
+        return;
+    }
+
+    m_focusTimer.stop();
+    stopWatchingFocus();
+    Trace::span("paste: wait for focus", m_phaseBegin, Trace::now());
+    m_phaseBegin = Trace::now();
+
+    if (!m_typeText.empty()) {
+        m_state = State::Typing;
+        std::string text;
+        text.swap(m_typeText);
+        if (!m_keyTyper->type(text)) {
+            finish(false);
+        }
+        return;
+    }
+
+    m_state = State::WaitingForTransfer;
+    emit aboutToPaste();
+
+    QCoreApplication::instance()->installNativeEventFilter(this);
+    m_clipboardHandler->sendCtrlV(X11Connection::instance().display());
+    m_transferTimer.start();
+    // The key events' XSyncs may have queued the target's selection
+    // request, which would otherwise wait for the next socket activity
+    X11Connection::instance().processPendingEvents();
+}
+
+void PasteSequencer::finish(bool transferred)
+{
+    if (m_state == State::Idle) {
+        return;
+    }
+
+    Trace::span(m_state == State::Typing ? "paste: typing" : "paste: wait for transfer", m_phaseBegin, Trace::now(),
+                transferred ? "" : "timed out");
+
+    // Only once the text is in; after a timed out transfer there may be
+    // nothing to move through
+    if (transferred && m_cursorBack > 0) {
+        m_clipboardHandler->sendCursorLeft(X11Connection::instance().display(), m_cursorBack);
+    }
+    m_cursorBack = 0;
+
+    m_state = State::Idle;
+    m_focusTimer.stop();
+    m_transferTimer.stop();
+    stopWatchingFocus();
+    QCoreApplication::instance()->removeNativeEventFilter(this);
+    m_target = 0;
+    m_typeText.clear();
+
+    emit finished(transferred);
+}
+
+void PasteSequencer::stopWatchingFocus()
+{
+    if (!m_watchingFocus) {
+        return;
+    }
+
+    Display *display = X11Connection::instance().display();
+    XSelectInput(display, m_target, NoEventMask);
+    XSelectInput(display, DefaultRootWindow(display), NoEventMask);
+    XFlush(display);
+    X11Connection::instance().removeEventHandler(this);
+    m_watchingFocus = false;
+}
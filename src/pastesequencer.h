@@ -0,0 +1,75 @@
+#ifndef PASTESEQUENCER_H
+#define PASTESEQUENCER_H
+
+#include <QObject>
+#include <QAbstractNativeEventFilter>
+#include <QTimer>
+#include <string>
+#include "x11connection.h"
+
+class ClipboardHandler;
+class KeyTyper;
+
+// Drives a paste by readiness instead of fixed delays:
+//  1. focus the target and wait for its FocusIn (or _NET_ACTIVE_WINDOW)
+//  2. send Ctrl+V
+//  3. wait until a client has fetched the clipboard contents
+// Each wait has a timeout that only applies when the event never comes.
+//
+// In type mode step 2 types the text itself and step 3 is skipped.
+// A cursor offset moves the cursor back into the text at the end.
+class PasteSequencer : public QObject, public X11EventHandler, public QAbstractNativeEventFilter
+{
+    Q_OBJECT
+
+public:
+    explicit PasteSequencer(ClipboardHandler *clipboardHandler, QObject *parent = nullptr);
+    ~PasteSequencer();
+
+    void setFocusTimeout(int msecs);
+    void setTransferTimeout(int msecs);
+
+    // Paste into target; finished() is emitted once the sequence ends.
+    // cursorBack is the number of characters to move left afterwards
+    void start(Window target, int cursorBack = 0);
+    // Type text into target instead of pasting it
+    void startTyping(Window target, const std::string &text, int cursorBack = 0);
+
+    KeyTyper *keyTyper() const { return m_keyTyper; }
+
+    bool x11Event(XEvent *event) override;
+    bool nativeEventFilter(const QByteArray &eventType, void *message, long *result) override;
+
+signals:
+    // Right before Ctrl+V is sent; the clipboard must hold the text when
+    // the receiver returns
+    void aboutToPaste();
+    // transferred is false when the transfer wait timed out
+    void finished(bool transferred);
+
+private:
+    enum class State {
+        Idle,
+        WaitingForFocus,
+        WaitingForTransfer,
+        Typing
+    };
+
+    bool targetHasFocus() const;
+    void sendPaste();
+    void finish(bool transferred);
+    void stopWatchingFocus();
+
+    ClipboardHandler *m_clipboardHandler;
+    KeyTyper *m_keyTyper;
+    std::string m_typeText; // typed once the target has focus, if set
+    int m_cursorBack;
+    int64_t m_phaseBegin; // Trace::now() when the current wait started
+    State m_state;
+    Window m_target;
+    bool m_watchingFocus;
+    QTimer m_focusTimer;
+    QTimer m_transferTimer;
+};
+
+#endif // PASTESEQUENCER_H
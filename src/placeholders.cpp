@@ -0,0 +1,177 @@
+#include "placeholders.h"
+#include <QString>
+#include <QTextBoundaryFinder>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+const char DefaultDateFormat[] = "%Y-%m-%d";
+
+bool parsePlaceholder(const std::string &content, size_t begin, size_t end, TemplateSegment &segment)
+{
+    // content[begin, end) is the text between "{{" and "}}"
+    struct Name {
+        const char *text;
+        TemplateSegment::Kind kind;
+        bool argument;
+    };
+    static const Name names[] = {
+        {"date", TemplateSegment::Date, true},
+        {"clipboard", TemplateSegment::Clipboard, false},
+        {"env", TemplateSegment::Env, true},
+        {"cursor", TemplateSegment::Cursor, false},
+    };
+
+    const size_t colon = content.find(':', begin);
+    const size_t nameEnd = colon < end ? colon : end;
+    for (const Name &name : names) {
+        const size_t length = std::strlen(name.text);
+        if (nameEnd - begin != length || content.compare(begin, length, name.text) != 0) {
+            continue;
+        }
+        if (colon < end && !name.argument) {
+            return false;
+        }
+        segment.kind = name.kind;
+        segment.offset = static_cast<uint32_t>(colon < end ? colon + 1 : end);
+        segment.size = static_cast<uint32_t>(colon < end ? end - colon - 1 : 0);
+        // {{env}} names no variable
+        return name.kind != TemplateSegment::Env || segment.size > 0;
+    }
+    return false;
+}
+
+void appendDate(std::string &out, const std::string &format, const std::tm &now)
+{
+    if (format.empty()) {
+        return;
+    }
+    char buffer[256];
+    const size_t length = std::strftime(buffer, sizeof(buffer), format.c_str(), &now);
+    out.append(buffer, length);
+}
+
+} // namespace
+
+void Placeholders::compile(Template &tmpl)
+{
+    tmpl.segments.clear();
+    const std::string &content = tmpl.content;
+
+    size_t literal = 0; // start of the pending literal run
+    size_t pos = content.find("{{");
+    if (pos == std::string::npos) {
+        return; // the common case; nothing to expand
+    }
+
+    std::vector<TemplateSegment> segments;
+    while (pos != std::string::npos) {
+        const size_t close = content.find("}}", pos + 2);
+        if (close == std::string::npos) {
+            break;
+        }
+        // "{{{{x}}" keeps the outer braces as text
+        const size_t open = content.rfind("{{", close);
+
+        TemplateSegment segment;
+        if (parsePlaceholder(content, open + 2, close, segment)) {
+            if (open > literal) {
+                segments.push_back({TemplateSegment::Literal, static_cast<uint32_t>(literal),
+                                    static_cast<uint32_t>(open - literal)});
+            }
+            segments.push_back(segment);
+            literal = close + 2;
+        }
+        pos = content.find("{{", close + 2);
+    }
+
+    if (segments.empty()) {
+        return; // braces, but no placeholders
+    }
+    if (literal < content.size()) {
+        segments.push_back({TemplateSegment::Literal, static_cast<uint32_t>(literal),
+                            static_cast<uint32_t>(content.size() - literal)});
+    }
+    segments.shrink_to_fit();
+    tmpl.segments = std::move(segments);
+}
+
+bool Placeholders::usesClipboard(const Template &tmpl)
+{
+    for (const auto &segment : tmpl.segments) {
+        if (segment.kind == TemplateSegment::Clipboard) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string Placeholders::expand(const Template &tmpl, const ClipboardText &clipboard, int *cursorBack)
+{
+    if (cursorBack) {
+        *cursorBack = 0;
+    }
+    if (tmpl.segments.empty()) {
+        return tmpl.content;
+    }
+
+    // Values that do not fit the reservation only cost a regrowth
+    std::string clipboardText;
+    size_t reserve = tmpl.content.size();
+    if (usesClipboard(tmpl) && clipboard) {
+        clipboardText = clipboard();
+        reserve += clipboardText.size();
+    }
+
+    std::tm now = {};
+    bool haveTime = false;
+    size_t cursor = std::string::npos;
+
+    std::string out;
+    out.reserve(reserve);
+    for (const auto &segment : tmpl.segments) {
+        switch (segment.kind) {
+        case TemplateSegment::Literal:
+            out.append(tmpl.content, segment.offset, segment.size);
+            break;
+        case TemplateSegment::Date:
+            if (!haveTime) {
+                const std::time_t time = std::time(nullptr);
+                localtime_r(&time, &now);
+                haveTime = true;
+            }
+            appendDate(out, segment.size ? tmpl.content.substr(segment.offset, segment.size) : DefaultDateFormat, now);
+            break;
+        case TemplateSegment::Clipboard:
+            out += clipboardText;
+            break;
+        case TemplateSegment::Env: {
+            const std::string name = tmpl.content.substr(segment.offset, segment.size);
+            if (const char *value = std::getenv(name.c_str())) {
+                out += value;
+            }
+            break;
+        }
+        case TemplateSegment::Cursor:
+            if (cursor == std::string::npos) {
+                cursor = out.size();
+            }
+            break;
+        }
+    }
+
+    if (cursorBack && cursor != std::string::npos) {
+        // One Left press per user-perceived character: a base letter with
+        // its combining marks, an emoji ZWJ sequence, or CRLF
+        const QString after = QString::fromUtf8(out.data() + cursor, static_cast<int>(out.size() - cursor));
+        QTextBoundaryFinder graphemes(QTextBoundaryFinder::Grapheme, after);
+        int characters = 0;
+        while (graphemes.toNextBoundary() != -1) {
+            ++characters;
+        }
+        *cursorBack = characters;
+    }
+    return out;
+}
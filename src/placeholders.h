@@ -0,0 +1,33 @@
+#ifndef PLACEHOLDERS_H
+#define PLACEHOLDERS_H
+
+#include <functional>
+#include <string>
+#include "templatemanager.h"
+
+// Placeholders in template content:
+//   {{date:FORMAT}}  the current local time as strftime FORMAT
+//                    ({{date}} alone is %Y-%m-%d)
+//   {{clipboard}}    the clipboard text from before the paste
+//   {{env:NAME}}     the environment variable NAME
+//   {{cursor}}       removed; the cursor is moved back here after pasting
+// Anything else in braces is kept as written.
+//
+// Content is compiled once at load time into Template::segments, so a
+// paste only walks the segments. Templates without placeholders keep
+// an empty segment list and are pasted as they are.
+class Placeholders {
+public:
+    // Fetched only when the template uses {{clipboard}}
+    using ClipboardText = std::function<std::string()>;
+
+    static void compile(Template &tmpl);
+
+    static bool usesClipboard(const Template &tmpl);
+
+    // The text to paste; cursorBack receives the number of grapheme
+    // clusters after the {{cursor}} marker, or 0 without one
+    static std::string expand(const Template &tmpl, const ClipboardText &clipboard, int *cursorBack = nullptr);
+};
+
+#endif // PLACEHOLDERS_H
@@ -0,0 +1,29 @@
+#include "searchfold.h"
+#include <QString>
+
+std::string SearchFold::fold(const std::string &text)
+{
+    QString folded = QString::fromStdString(text)
+                         .normalized(QString::NormalizationForm_KC)
+                         .toCaseFolded();
+
+    for (QChar &ch : folded) {
+        const ushort code = ch.unicode();
+        // Katakana ァ..ヶ and the iteration marks ヽヾ sit 0x60 above hiragana
+        if ((code >= 0x30A1 && code <= 0x30F6) || code == 0x30FD || code == 0x30FE) {
+            ch = QChar(static_cast<ushort>(code - 0x60));
+        }
+    }
+
+    return folded.toStdString();
+}
+
+std::string SearchFold::searchKey(const Template &tmpl)
+{
+    std::string key = fold(tmpl.name);
+    key.push_back('\0');
+    key += fold(tmpl.category);
+    key.push_back('\0');
+    key += fold(tmpl.content);
+    return key;
+}
@@ -0,0 +1,20 @@
+#ifndef SEARCHFOLD_H
+#define SEARCHFOLD_H
+
+#include <string>
+#include "templatemanager.h"
+
+// Folds text into a canonical form for matching: NFKC (full-width and
+// half-width forms), Unicode case folding and katakana to hiragana.
+// Template keys are folded once at load time and queries per keystroke,
+// so matching is a plain byte search over UTF-8.
+class SearchFold {
+public:
+    static std::string fold(const std::string &text);
+
+    // Folded name, category and content joined with '\0' so a query
+    // (which never contains '\0') cannot match across fields
+    static std::string searchKey(const Template &tmpl);
+};
+
+#endif // SEARCHFOLD_H
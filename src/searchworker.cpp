@@ -0,0 +1,120 @@
+#include "searchworker.h"
+#include "searchfold.h"
+#include <QMetaType>
+#include <QRunnable>
+
+namespace {
+
+class SearchTask : public QRunnable
+{
+public:
+    explicit SearchTask(std::function<void()> work) : m_work(std::move(work)) {}
+    void run() override { m_work(); }
+
+private:
+    std::function<void()> m_work;
+};
+
+} // namespace
+
+SearchWorker::SearchWorker(QObject *parent)
+    : QObject(parent)
+    , m_tasks(0)
+    , m_mode(TemplateSearch::Mode::Substring)
+    , m_generation(0)
+{
+    // std::vector is a built-in sequential metatype; register it for queued delivery
+    qRegisterMetaType<std::vector<uint32_t>>("std::vector<uint32_t>");
+    // A single runner serializes access to m_search and its refinement history
+    m_pool.setMaxThreadCount(1);
+    // Kept for the life of the worker instead of respawned per keystroke
+    m_pool.setExpiryTimeout(-1);
+}
+
+SearchWorker::~SearchWorker()
+{
+    cancelAndWait();
+}
+
+void SearchWorker::setTemplates(const TemplateStore &templates)
+{
+    cancelAndWait();
+    m_search.setTemplates(templates);
+}
+
+void SearchWorker::applyDiff(TemplateStore &templates, const TemplateDiff &diff,
+                             const std::vector<Template> &incoming)
+{
+    cancelAndWait();
+    m_search.applyDiff(templates, diff, incoming);
+}
+
+void SearchWorker::appendTemplates(TemplateStore &templates, const std::vector<Template> &incoming)
+{
+    cancelAndWait();
+    m_search.appendTemplates(templates, incoming);
+}
+
+void SearchWorker::setMode(TemplateSearch::Mode mode)
+{
+    m_mode = mode;
+    cancelAndWait();
+    m_search.setMode(mode);
+}
+
+void SearchWorker::setFuzzyResultLimit(size_t limit)
+{
+    cancelAndWait();
+    m_search.setFuzzyResultLimit(limit);
+}
+
+void SearchWorker::setBoosts(std::vector<int> boosts)
+{
+    cancelAndWait();
+    m_search.setBoosts(std::move(boosts));
+}
+
+void SearchWorker::setBoost(uint32_t id, int boost)
+{
+    cancelAndWait();
+    m_search.setBoost(id, boost);
+}
+
+quint64 SearchWorker::search(const QString &query)
+{
+    const quint64 generation = ++m_generation;
+    const std::string text = query.toStdString();
+
+    {
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        ++m_tasks;
+    }
+    m_pool.start(new SearchTask([this, generation, text]() {
+        auto stale = [this, generation]() { return m_generation.load() != generation; };
+        std::vector<uint32_t> results;
+        // Skipped when superseded while queued
+        if (!stale() && m_search.search(SearchFold::fold(text), results, stale) && !stale()) {
+            emit resultsReady(generation, results);
+        }
+        taskDone();
+    }));
+
+    return generation;
+}
+
+void SearchWorker::cancelAndWait()
+{
+    ++m_generation;
+    // Counted rather than QThreadPool::waitForDone(), which also stops the
+    // pool's thread; see TemplateSearch::refine
+    std::unique_lock<std::mutex> lock(m_tasksMutex);
+    m_tasksDone.wait(lock, [this]() { return m_tasks == 0; });
+}
+
+void SearchWorker::taskDone()
+{
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    if (--m_tasks == 0) {
+        m_tasksDone.notify_all();
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef SEARCHWORKER_H
+#define SEARCHWORKER_H
+
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "templatesearch.h"
+
+// Runs TemplateSearch off the GUI thread. Searches execute one at a time
+// on a private pool (each one fans out over the cores itself); a newer
+// query cancels the one in flight, and results are delivered through a
+// queued signal tagged with the generation of the query that produced them.
+class SearchWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SearchWorker(QObject *parent = nullptr);
+    ~SearchWorker();
+
+    // Blocks until the running search has stopped; the store must outlive
+    // the worker or be replaced by another call
+    void setTemplates(const TemplateStore &templates);
+
+    // Blocks like setTemplates(); see TemplateSearch::applyDiff
+    void applyDiff(TemplateStore &templates, const TemplateDiff &diff, const std::vector<Template> &incoming);
+    void appendTemplates(TemplateStore &templates, const std::vector<Template> &incoming);
+
+    void setMode(TemplateSearch::Mode mode);
+    TemplateSearch::Mode mode() const { return m_mode; }
+    void setFuzzyResultLimit(size_t limit);
+    void setBoosts(std::vector<int> boosts);
+    void setBoost(uint32_t id, int boost);
+
+    // Start a search for the (unfolded) query and return its generation
+    quint64 search(const QString &query);
+
+    // Generation of the most recent query; older results are stale
+    quint64 currentGeneration() const { return m_generation.load(); }
+
+    // Stop the running search and wait for it; searches already queued
+    // are dropped
+    void cancelAndWait();
+
+signals:
+    void resultsReady(quint64 generation, const std::vector<uint32_t> &results);
+
+private:
+    void taskDone();
+
+    QThreadPool m_pool;
+    std::mutex m_tasksMutex;
+    std::condition_variable m_tasksDone;
+    int m_tasks; // started and not yet returned, guarded by m_tasksMutex
+    TemplateSearch m_search; // only touched from m_pool, or while it is idle
+    TemplateSearch::Mode m_mode;
+    std::atomic<quint64> m_generation;
+};
+
+#endif // SEARCHWORKER_H
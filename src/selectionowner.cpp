@@ -0,0 +1,273 @@
+#include "selectionowner.h"
+#include <QDebug>
+#include <QString>
+#include <algorithm>
+
+// X11 headers must be included after Qt headers
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#undef None
+#undef KeyPress
+#undef KeyRelease
+#undef FocusIn
+#undef FocusOut
+
+namespace {
+const unsigned long NoAtom = 0L;             // None, undefined above to avoid clashing with Qt
+const size_t MaxChunkSize = 256 * 1024;      // bytes per INCR chunk
+const int StaleTransferTimeout = 10000;      // ms without progress before an INCR is dropped
+}
+
+SelectionOwner::SelectionOwner(QObject *parent)
+    : QObject(parent)
+    , m_window(0)
+    , m_ownershipTime(0)
+    , m_owned(false)
+    , m_chunkSize(MaxChunkSize)
+{
+    m_staleTransferTimer.setSingleShot(true);
+    m_staleTransferTimer.setInterval(StaleTransferTimeout);
+    connect(&m_staleTransferTimer, &QTimer::timeout, this, [this]() {
+        if (!m_transfers.empty()) {
+            qDebug() << "[clip-template] Dropping" << (int)m_transfers.size() << "stalled INCR transfer(s).";
+            m_transfers.clear();
+        }
+    });
+}
+
+SelectionOwner::~SelectionOwner()
+{
+    X11Connection::instance().removeEventHandler(this);
+    Display *display = X11Connection::instance().display();
+    if (display && m_window) {
+        XDestroyWindow(display, m_window);
+        XFlush(display);
+    }
+}
+
+const std::string &SelectionOwner::text() const
+{
+    static const std::string empty;
+    return m_data ? *m_data : empty;
+}
+
+bool SelectionOwner::setText(std::string text)
+{
+    if (!ensureWindow()) {
+        return false;
+    }
+
+    X11Connection &x11 = X11Connection::instance();
+    Display *display = x11.display();
+    const Atom clipboard = x11.atom(X11Connection::Clipboard);
+
+    m_data = std::make_shared<const std::string>(std::move(text));
+    m_ownershipTime = serverTime();
+    XSetSelectionOwner(display, clipboard, m_window, m_ownershipTime);
+    m_owned = XGetSelectionOwner(display, clipboard) == m_window;
+
+    // The round trips above may have queued requests for us
+    x11.processPendingEvents();
+    return m_owned;
+}
+
+bool SelectionOwner::x11Event(XEvent *event)
+{
+    const X11Connection &x11 = X11Connection::instance();
+
+    switch (event->type) {
+    case SelectionRequest:
+        if (event->xselectionrequest.owner != m_window) {
+            return false;
+        }
+        handleSelectionRequest(event);
+        return true;
+
+    case SelectionClear:
+        if (event->xselectionclear.window != m_window ||
+            event->xselectionclear.selection != x11.atom(X11Connection::Clipboard)) {
+            return false;
+        }
+        // Running INCR transfers keep their own reference to the data
+        m_owned = false;
+        m_data.reset();
+        return true;
+
+    case PropertyNotify:
+        if (event->xproperty.state != PropertyDelete) {
+            return false;
+        }
+        continueTransfer(event->xproperty.window, event->xproperty.atom);
+        return false;
+
+    default:
+        return false;
+    }
+}
+
+bool SelectionOwner::ensureWindow()
+{
+    X11Connection &x11 = X11Connection::instance();
+    Display *display = x11.display();
+    if (!display) {
+        return false;
+    }
+    if (m_window) {
+        return true;
+    }
+
+    m_window = XCreateSimpleWindow(display, DefaultRootWindow(display), -10, -10, 1, 1, 0, 0, 0);
+    XSelectInput(display, m_window, PropertyChangeMask);
+
+    // Leave headroom for the ChangeProperty request header
+    long maxRequest = XExtendedMaxRequestSize(display);
+    if (maxRequest == 0) {
+        maxRequest = XMaxRequestSize(display);
+    }
+    m_chunkSize = std::min(MaxChunkSize, static_cast<size_t>(maxRequest) * 4 - 1024);
+
+    x11.addEventHandler(this);
+    return true;
+}
+
+unsigned long SelectionOwner::serverTime()
+{
+    // ICCCM: use a real timestamp, obtained from a zero-length property append
+    Display *display = X11Connection::instance().display();
+    const Atom property = X11Connection::instance().atom(X11Connection::TimestampProperty);
+    XChangeProperty(display, m_window, property, XA_STRING, 8, PropModeAppend, nullptr, 0);
+
+    XEvent event;
+    do {
+        XWindowEvent(display, m_window, PropertyChangeMask, &event);
+    } while (event.xproperty.atom != property);
+    return event.xproperty.time;
+}
+
+void SelectionOwner::handleSelectionRequest(XEvent *event)
+{
+    const XSelectionRequestEvent &request = event->xselectionrequest;
+    Display *display = X11Connection::instance().display();
+
+    // Obsolete clients pass no property; the target doubles as one
+    const Atom property = request.property != NoAtom ? request.property : request.target;
+    const bool converted = m_owned && m_data &&
+                           (request.time == CurrentTime || request.time >= m_ownershipTime) &&
+                           convert(request.requestor, request.target, property);
+
+    XEvent reply;
+    reply.xselection.type = SelectionNotify;
+    reply.xselection.serial = 0;
+    reply.xselection.send_event = True;
+    reply.xselection.display = display;
+    reply.xselection.requestor = request.requestor;
+    reply.xselection.selection = request.selection;
+    reply.xselection.target = request.target;
+    reply.xselection.property = converted ? property : NoAtom;
+    reply.xselection.time = request.time;
+    XSendEvent(display, request.requestor, False, NoEventMask, &reply);
+    XFlush(display);
+
+    if (converted && request.target != X11Connection::instance().atom(X11Connection::Targets) &&
+        request.target != X11Connection::instance().atom(X11Connection::Timestamp) &&
+        std::none_of(m_transfers.begin(), m_transfers.end(), [&](const Transfer &transfer) {
+            return transfer.requestor == request.requestor && transfer.property == property;
+        })) {
+        emit transferCompleted();
+    }
+}
+
+bool SelectionOwner::convert(Window requestor, Atom target, Atom property)
+{
+    const X11Connection &x11 = X11Connection::instance();
+    Display *display = x11.display();
+
+    if (target == x11.atom(X11Connection::Targets)) {
+        const Atom targets[] = {
+            x11.atom(X11Connection::Targets),
+            x11.atom(X11Connection::Timestamp),
+            x11.atom(X11Connection::Utf8String),
+            x11.atom(X11Connection::Text),
+            XA_STRING,
+        };
+        XChangeProperty(display, requestor, property, XA_ATOM, 32, PropModeReplace,
+                        reinterpret_cast<const unsigned char *>(targets), sizeof(targets) / sizeof(targets[0]));
+        return true;
+    }
+
+    if (target == x11.atom(X11Connection::Timestamp)) {
+        const long time = static_cast<long>(m_ownershipTime);
+        XChangeProperty(display, requestor, property, XA_INTEGER, 32, PropModeReplace,
+                        reinterpret_cast<const unsigned char *>(&time), 1);
+        return true;
+    }
+
+    const bool latin1 = target == XA_STRING;
+    if (target != x11.atom(X11Connection::Utf8String) && target != x11.atom(X11Connection::Text) && !latin1) {
+        return false; // includes MULTIPLE, which is not supported
+    }
+
+    // STRING is Latin-1 by definition; other characters become '?'
+    std::shared_ptr<const std::string> converted = m_data;
+    if (latin1) {
+        const QByteArray bytes = QString::fromStdString(*m_data).toLatin1();
+        converted = std::make_shared<const std::string>(bytes.constData(), static_cast<size_t>(bytes.size()));
+    }
+    const Atom type = latin1 ? XA_STRING : x11.atom(X11Connection::Utf8String);
+
+    const std::string &data = *converted;
+    if (data.size() <= m_chunkSize) {
+        XChangeProperty(display, requestor, property, type, 8, PropModeReplace,
+                        reinterpret_cast<const unsigned char *>(data.data()), static_cast<int>(data.size()));
+        return true;
+    }
+
+    // INCR: announce the size; chunks follow each time the requestor
+    // deletes the property
+    XSelectInput(display, requestor, PropertyChangeMask);
+    const long size = static_cast<long>(data.size());
+    XChangeProperty(display, requestor, property, x11.atom(X11Connection::Incr), 32, PropModeReplace,
+                    reinterpret_cast<const unsigned char *>(&size), 1);
+
+    m_transfers.erase(std::remove_if(m_transfers.begin(), m_transfers.end(), [&](const Transfer &transfer) {
+        return transfer.requestor == requestor && transfer.property == property;
+    }), m_transfers.end());
+    m_transfers.push_back({requestor, property, type, converted, 0});
+    m_staleTransferTimer.start();
+    return true;
+}
+
+void SelectionOwner::continueTransfer(Window requestor, Atom property)
+{
+    auto it = std::find_if(m_transfers.begin(), m_transfers.end(), [&](const Transfer &transfer) {
+        return transfer.requestor == requestor && transfer.property == property;
+    });
+    if (it == m_transfers.end()) {
+        return;
+    }
+
+    const X11Connection &x11 = X11Connection::instance();
+    Display *display = x11.display();
+    const std::string &data = *it->data;
+    const size_t chunk = std::min(m_chunkSize, data.size() - it->offset);
+
+    // A zero-length chunk marks the end of the transfer
+    XChangeProperty(display, requestor, property, it->type, 8, PropModeReplace,
+                    reinterpret_cast<const unsigned char *>(data.data() + it->offset), static_cast<int>(chunk));
+    it->offset += chunk;
+    m_staleTransferTimer.start();
+
+    if (chunk == 0) {
+        m_transfers.erase(it);
+        // Other transfers to this window still need its PropertyNotify
+        if (std::none_of(m_transfers.begin(), m_transfers.end(), [&](const Transfer &transfer) {
+                return transfer.requestor == requestor;
+            })) {
+            XSelectInput(display, requestor, NoEventMask);
+        }
+        XFlush(display);
+        emit transferCompleted();
+        return;
+    }
+    XFlush(display);
+}
@@ -0,0 +1,61 @@
+#ifndef SELECTIONOWNER_H
+#define SELECTIONOWNER_H
+
+#include <QObject>
+#include <QTimer>
+#include <memory>
+#include <string>
+#include <vector>
+#include "x11connection.h"
+
+// Owns the CLIPBOARD selection on the shared X connection and serves
+// UTF8_STRING/TEXT requests straight from the stored UTF-8 bytes, and
+// STRING requests from older clients as Latin-1. COMPOUND_TEXT is not
+// offered; clients that know it also know STRING.
+// Payloads larger than one request are sent with the ICCCM INCR protocol.
+class SelectionOwner : public QObject, public X11EventHandler
+{
+    Q_OBJECT
+
+public:
+    explicit SelectionOwner(QObject *parent = nullptr);
+    ~SelectionOwner();
+
+    // Take ownership of CLIPBOARD with the given text; false if there is
+    // no X connection or another client kept the selection
+    bool setText(std::string text);
+
+    bool ownsSelection() const { return m_owned; }
+    const std::string &text() const;
+
+    bool x11Event(XEvent *event) override;
+
+signals:
+    // A requestor received the full data (after the last INCR chunk)
+    void transferCompleted();
+
+private:
+    struct Transfer {
+        Window requestor;
+        Atom property;
+        Atom type;
+        std::shared_ptr<const std::string> data;
+        size_t offset;
+    };
+
+    bool ensureWindow();
+    unsigned long serverTime();
+    void handleSelectionRequest(XEvent *event);
+    bool convert(Window requestor, Atom target, Atom property);
+    void continueTransfer(Window requestor, Atom property);
+
+    Window m_window;
+    std::shared_ptr<const std::string> m_data;
+    unsigned long m_ownershipTime;
+    bool m_owned;
+    size_t m_chunkSize;
+    std::vector<Transfer> m_transfers;
+    QTimer m_staleTransferTimer;
+};
+
+#endif // SELECTIONOWNER_H
@@ -0,0 +1,48 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <string>
+#include <vector>
+
+// Options read from ~/.config/clip-template/settings.yaml.
+// Every field keeps its default when the file or key is missing.
+struct Settings {
+    // search.mode: "substring" or "fuzzy"
+    std::string searchMode;
+    // search.fuzzy_limit: maximum number of ranked fuzzy results
+    int fuzzyResultLimit;
+    // paste.focus_timeout_ms: longest wait for the target to regain focus
+    int focusTimeout;
+    // paste.transfer_timeout_ms: longest wait for the target to fetch the
+    // clipboard before the previous contents are restored
+    int transferTimeout;
+    // paste.mode: "clipboard" (Ctrl+V) or "type" (XTest key events)
+    std::string pasteMode;
+    // paste.type_batch_size: characters typed per batch in type mode
+    int typeBatchSize;
+    // paste.type_batch_interval_ms: pause between batches in type mode
+    int typeBatchInterval;
+    // clipboard.snapshot_max_bytes: most bytes of the previous clipboard
+    // kept for restoring after a paste
+    long long snapshotMaxBytes;
+    // clipboard.snapshot_formats: wildcard patterns of the formats kept;
+    // all by default, leaving the choice to the byte limit
+    std::vector<std::string> snapshotFormats;
+    // clipboard.snapshot_timeout_ms: longest wait for the previous owner
+    int snapshotTimeout;
+
+    Settings()
+        : searchMode("substring")
+        , fuzzyResultLimit(500)
+        , focusTimeout(200)
+        , transferTimeout(1000)
+        , pasteMode("clipboard")
+        , typeBatchSize(64)
+        , typeBatchInterval(10)
+        , snapshotMaxBytes(4 * 1024 * 1024)
+        , snapshotFormats({"*"})
+        , snapshotTimeout(150)
+    {}
+};
+
+#endif // SETTINGS_H
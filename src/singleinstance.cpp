@@ -0,0 +1,72 @@
+#include "singleinstance.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QStandardPaths>
+#include <QDebug>
+
+namespace {
+const char ShowCommand[] = "show\n";
+}
+
+SingleInstance::SingleInstance(QObject *parent)
+    : QObject(parent)
+    , m_server(new QLocalServer(this))
+{
+    connect(m_server, &QLocalServer::newConnection, this, &SingleInstance::onNewConnection);
+}
+
+SingleInstance::~SingleInstance() = default;
+
+bool SingleInstance::listen()
+{
+    // A live server answers connections; anything else is a stale socket file
+    // left behind by a crashed daemon and can be removed.
+    if (activateRunningInstance()) {
+        return false;
+    }
+
+    QLocalServer::removeServer(serverName());
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server->listen(serverName())) {
+        qDebug() << "[clip-template] Failed to listen on" << serverName() << ":" << m_server->errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool SingleInstance::activateRunningInstance()
+{
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    if (!socket.waitForConnected(100)) {
+        return false;
+    }
+
+    socket.write(ShowCommand);
+    socket.waitForBytesWritten(500);
+    socket.disconnectFromServer();
+    return true;
+}
+
+void SingleInstance::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QLocalSocket::deleteLater);
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            const QByteArray request = socket->readAll();
+            if (request.contains(ShowCommand)) {
+                emit activationRequested();
+            }
+        });
+    }
+}
+
+QString SingleInstance::serverName()
+{
+    QString runtimeDir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    if (runtimeDir.isEmpty()) {
+        return QString("clip-template-%1").arg(QString::fromLocal8Bit(qgetenv("USER")));
+    }
+    return runtimeDir + "/clip-template.sock";
+}
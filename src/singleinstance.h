@@ -0,0 +1,38 @@
+#ifndef SINGLEINSTANCE_H
+#define SINGLEINSTANCE_H
+
+#include <QObject>
+#include <QString>
+
+class QLocalServer;
+
+// Local socket used to hand hotkey activations to a resident (--daemon)
+// process instead of starting a new one for every press.
+class SingleInstance : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SingleInstance(QObject *parent = nullptr);
+    ~SingleInstance();
+
+    // Start listening; fails when another resident instance already owns the socket
+    bool listen();
+
+    // Ask a running resident instance to show its popup.
+    // Returns false when none is running.
+    static bool activateRunningInstance();
+
+signals:
+    void activationRequested();
+
+private slots:
+    void onNewConnection();
+
+private:
+    static QString serverName();
+
+    QLocalServer *m_server;
+};
+
+#endif // SINGLEINSTANCE_H
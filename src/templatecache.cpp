@@ -0,0 +1,274 @@
+#include "templatecache.h"
+#include "hashutil.h"
+#include "templatestore.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+namespace {
+
+const char CacheMagic[8] = {'C', 'L', 'P', 'T', 'C', 'A', 'C', 'H'};
+const uint32_t CacheVersion = 3;
+// Bytes collected before they are written out
+const size_t WriteBufferSize = 1 << 20;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    int64_t sourceMtime;
+    uint64_t sourceSize;
+    uint64_t sourceHash;
+};
+
+// Per-template record header; the compiled placeholder segments follow,
+// then the four strings back to back, padded so the next record starts
+// 4-byte aligned and its segments can be used in place
+struct RecordHeader {
+    int32_t shortcut;
+    uint32_t segmentCount;
+    uint32_t nameSize;
+    uint32_t contentSize;
+    uint32_t categorySize;
+    uint32_t searchKeySize;
+};
+
+static_assert(std::is_trivially_copyable<TemplateSegment>::value && alignof(TemplateSegment) <= 4 &&
+              sizeof(CacheHeader) % 4 == 0 && sizeof(RecordHeader) % 4 == 0,
+              "records are read in place from the mapping");
+
+size_t padding(uint64_t size)
+{
+    return static_cast<size_t>((4 - size % 4) % 4);
+}
+
+// One record, pointing into the mapped cache
+struct RecordView {
+    int shortcut;
+    const TemplateSegment *segments;
+    size_t segmentCount;
+    std::string_view name;
+    std::string_view content;
+    std::string_view category;
+    std::string_view searchKey;
+};
+
+bool hashSourceFile(const QString &path, uint64_t &hash)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    if (file.size() == 0) {
+        hash = fnv1a64(nullptr, 0);
+        return true;
+    }
+
+    const uchar *data = file.map(0, file.size());
+    if (!data) {
+        return false;
+    }
+    hash = fnv1a64(reinterpret_cast<const char *>(data), static_cast<size_t>(file.size()));
+    file.unmap(const_cast<uchar *>(data));
+    return true;
+}
+
+// Maps the cache at cachePath if it is current for the source, calls
+// onCount with the number of records and onRecord for each of them; false
+// if it is missing, stale or truncated, possibly after some records
+template <typename OnCount, typename OnRecord>
+bool readCache(const std::string &sourcePath, const std::string &cachePath, OnCount onCount, OnRecord onRecord)
+{
+    QFileInfo source(QString::fromStdString(sourcePath));
+    if (!source.exists()) {
+        return false;
+    }
+
+    QFile file(QString::fromStdString(cachePath));
+    if (!file.open(QIODevice::ReadOnly) || file.size() < static_cast<qint64>(sizeof(CacheHeader))) {
+        return false;
+    }
+
+    const uchar *data = file.map(0, file.size());
+    if (!data) {
+        return false;
+    }
+    const char *cursor = reinterpret_cast<const char *>(data);
+    const char *end = cursor + file.size();
+
+    CacheHeader header;
+    std::memcpy(&header, cursor, sizeof(header));
+    cursor += sizeof(header);
+
+    // Cheap checks first; only hash the YAML when they all pass
+    uint64_t sourceHash = 0;
+    if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 ||
+        header.version != CacheVersion ||
+        header.sourceMtime != source.lastModified().toMSecsSinceEpoch() ||
+        header.sourceSize != static_cast<uint64_t>(source.size()) ||
+        !hashSourceFile(source.filePath(), sourceHash) ||
+        header.sourceHash != sourceHash) {
+        return false;
+    }
+
+    onCount(header.count);
+    for (uint32_t i = 0; i < header.count; ++i) {
+        RecordHeader record;
+        if (static_cast<size_t>(end - cursor) < sizeof(record)) {
+            return false;
+        }
+        std::memcpy(&record, cursor, sizeof(record));
+        cursor += sizeof(record);
+
+        const uint64_t strings = static_cast<uint64_t>(record.nameSize) + record.contentSize +
+                                 record.categorySize + record.searchKeySize;
+        const uint64_t payload = static_cast<uint64_t>(record.segmentCount) * sizeof(TemplateSegment) + strings +
+                                 padding(strings);
+        if (static_cast<uint64_t>(end - cursor) < payload) {
+            return false;
+        }
+
+        RecordView view;
+        view.shortcut = record.shortcut;
+        view.segments = reinterpret_cast<const TemplateSegment *>(cursor);
+        view.segmentCount = record.segmentCount;
+        cursor += record.segmentCount * sizeof(TemplateSegment);
+        view.name = std::string_view(cursor, record.nameSize);
+        cursor += record.nameSize;
+        view.content = std::string_view(cursor, record.contentSize);
+        cursor += record.contentSize;
+        view.category = std::string_view(cursor, record.categorySize);
+        cursor += record.categorySize;
+        view.searchKey = std::string_view(cursor, record.searchKeySize);
+        cursor += record.searchKeySize + padding(strings);
+        onRecord(view);
+    }
+    return true;
+}
+
+void appendBytes(QByteArray &out, const void *data, size_t size)
+{
+    out.append(static_cast<const char *>(data), static_cast<int>(size));
+}
+
+} // namespace
+
+TemplateCache::TemplateCache()
+{
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    m_cacheDir = (cacheDir + "/clip-template").toStdString();
+}
+
+TemplateCache::~TemplateCache() = default;
+
+bool TemplateCache::load(const std::string &sourcePath, std::vector<Template> &templates)
+{
+    std::vector<Template> result;
+    const bool loaded = readCache(sourcePath, cachePathFor(sourcePath), [&result](uint32_t count) {
+        result.reserve(count);
+    }, [&result](const RecordView &view) {
+        Template tmpl;
+        tmpl.shortcut = view.shortcut;
+        tmpl.name = std::string(view.name);
+        tmpl.content = std::string(view.content);
+        tmpl.category = std::string(view.category);
+        tmpl.searchKey = std::string(view.searchKey);
+        tmpl.segments.assign(view.segments, view.segments + view.segmentCount);
+        result.push_back(std::move(tmpl));
+    });
+    if (!loaded) {
+        return false;
+    }
+    templates = std::move(result);
+    return true;
+}
+
+bool TemplateCache::load(const std::string &sourcePath, TemplateStore &store)
+{
+    // Straight from the mapping into the store's arena
+    return readCache(sourcePath, cachePathFor(sourcePath), [&store](uint32_t count) {
+        store.reserve(store.size() + count);
+    }, [&store](const RecordView &view) {
+        store.append(view.name, view.content, view.category, view.searchKey, view.shortcut, view.segments,
+                     view.segmentCount);
+    });
+}
+
+bool TemplateCache::store(const std::string &sourcePath, const std::vector<Template> &templates)
+{
+    QFileInfo source(QString::fromStdString(sourcePath));
+    CacheHeader header;
+    std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+    header.version = CacheVersion;
+    header.count = static_cast<uint32_t>(templates.size());
+    header.sourceMtime = source.lastModified().toMSecsSinceEpoch();
+    header.sourceSize = static_cast<uint64_t>(source.size());
+    if (templates.size() > UINT32_MAX || !hashSourceFile(source.filePath(), header.sourceHash)) {
+        return false;
+    }
+
+    QDir().mkpath(QString::fromStdString(m_cacheDir));
+    QSaveFile file(QString::fromStdString(cachePathFor(sourcePath)));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    // Written out in pieces, so no single buffer has to hold a cache
+    // larger than a QByteArray can
+    QByteArray out;
+    out.reserve(static_cast<int>(WriteBufferSize)); // kept by resize(0)
+    auto flush = [&file, &out]() {
+        file.write(out);
+        out.resize(0);
+    };
+    appendBytes(out, &header, sizeof(header));
+    const char zeros[4] = {};
+    for (const auto &tmpl : templates) {
+        if (tmpl.name.size() > UINT32_MAX || tmpl.content.size() > UINT32_MAX ||
+            tmpl.category.size() > UINT32_MAX || tmpl.searchKey.size() > UINT32_MAX) {
+            file.cancelWriting();
+            return false;
+        }
+        RecordHeader record;
+        record.shortcut = tmpl.shortcut;
+        record.segmentCount = static_cast<uint32_t>(tmpl.segments.size());
+        record.nameSize = static_cast<uint32_t>(tmpl.name.size());
+        record.contentSize = static_cast<uint32_t>(tmpl.content.size());
+        record.categorySize = static_cast<uint32_t>(tmpl.category.size());
+        record.searchKeySize = static_cast<uint32_t>(tmpl.searchKey.size());
+        const uint64_t strings = static_cast<uint64_t>(record.nameSize) + record.contentSize +
+                                 record.categorySize + record.searchKeySize;
+
+        appendBytes(out, &record, sizeof(record));
+        appendBytes(out, tmpl.segments.data(), tmpl.segments.size() * sizeof(TemplateSegment));
+        // A string too large for the buffer goes straight to the file
+        for (const std::string *text : {&tmpl.name, &tmpl.content, &tmpl.category, &tmpl.searchKey}) {
+            if (text->size() >= WriteBufferSize) {
+                flush();
+                file.write(text->data(), static_cast<qint64>(text->size()));
+            } else {
+                appendBytes(out, text->data(), text->size());
+            }
+        }
+        appendBytes(out, zeros, padding(strings));
+        if (static_cast<size_t>(out.size()) >= WriteBufferSize) {
+            flush();
+        }
+    }
+    flush();
+    return file.commit();
+}
+
+std::string TemplateCache::cachePathFor(const std::string &sourcePath) const
+{
+    QString absolute = QFileInfo(QString::fromStdString(sourcePath)).absoluteFilePath();
+    uint64_t key = fnv1a64(absolute.toStdString());
+    return m_cacheDir + "/templates-" + QString::number(key, 16).toStdString() + ".bin";
+}
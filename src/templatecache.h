@@ -0,0 +1,31 @@
+#ifndef TEMPLATECACHE_H
+#define TEMPLATECACHE_H
+
+#include <string>
+#include <vector>
+#include "templatemanager.h"
+
+class TemplateStore;
+
+// Compiled binary copy of a templates.yaml, stored under
+// ~/.cache/clip-template/ and validated against the source file's
+// mtime, size and content hash. Records carry the search keys and the
+// compiled placeholders, so loading parses and compiles nothing.
+class TemplateCache {
+public:
+    TemplateCache();
+    ~TemplateCache();
+
+    // Fill templates from the cache; false if missing or stale
+    bool load(const std::string &sourcePath, std::vector<Template> &templates);
+    // Append the cached templates to store, copying them once from the
+    // mapped file; on failure the store may hold some of them
+    bool load(const std::string &sourcePath, TemplateStore &store);
+    bool store(const std::string &sourcePath, const std::vector<Template> &templates);
+
+private:
+    std::string cachePathFor(const std::string &sourcePath) const;
+    std::string m_cacheDir;
+};
+
+#endif // TEMPLATECACHE_H
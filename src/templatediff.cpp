@@ -0,0 +1,71 @@
+#include "templatediff.h"
+#include "hashutil.h"
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+std::string identity(std::string_view name, std::string_view category)
+{
+    std::string key;
+    key.reserve(name.size() + category.size() + 1);
+    key += name;
+    key += '\0';
+    key += category;
+    return key;
+}
+
+uint64_t contentHash(std::string_view content, int shortcut)
+{
+    return fnv1a64(content, fnv1a64(reinterpret_cast<const char *>(&shortcut), sizeof(shortcut)));
+}
+
+} // namespace
+
+TemplateDiff TemplateDiff::compute(const TemplateStore &slots, const std::vector<uint32_t> &order,
+                                   const std::vector<Template> &incoming)
+{
+    TemplateDiff diff;
+
+    // Live slots by identity, duplicates in file order
+    std::unordered_map<std::string, std::vector<uint32_t>> byIdentity;
+    byIdentity.reserve(order.size());
+    for (uint32_t id : order) {
+        byIdentity[identity(slots.name(id), slots.category(id))].push_back(id);
+    }
+
+    std::unordered_map<std::string, size_t> seen;
+    std::vector<bool> kept(slots.size(), false);
+    uint32_t nextSlot = static_cast<uint32_t>(slots.size());
+    diff.order.reserve(incoming.size());
+
+    for (size_t i = 0; i < incoming.size(); ++i) {
+        const Template &tmpl = incoming[i];
+        const std::string key = identity(tmpl.name, tmpl.category);
+        const size_t occurrence = seen[key]++;
+
+        auto it = byIdentity.find(key);
+        if (it == byIdentity.end() || occurrence >= it->second.size()) {
+            diff.added.push_back(static_cast<uint32_t>(i));
+            diff.order.push_back(nextSlot++);
+            continue;
+        }
+
+        const uint32_t id = it->second[occurrence];
+        kept[id] = true;
+        if (contentHash(slots.content(id), slots.shortcut(id)) != contentHash(tmpl.content, tmpl.shortcut)) {
+            diff.updated.emplace_back(id, static_cast<uint32_t>(i));
+        }
+        diff.order.push_back(id);
+    }
+
+    for (uint32_t id : order) {
+        if (!kept[id]) {
+            diff.removed.push_back(id);
+        }
+    }
+
+    // Additions and removals already change the order; otherwise compare
+    diff.reordered = diff.added.empty() && diff.removed.empty() && diff.order != order;
+    return diff;
+}
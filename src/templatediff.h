@@ -0,0 +1,30 @@
+#ifndef TEMPLATEDIFF_H
+#define TEMPLATEDIFF_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "templatestore.h"
+
+// Changes between the loaded templates and a freshly parsed list.
+//
+// Loaded templates live in slots whose ids never change while the
+// process runs, so the search index can be updated in place: updated
+// templates keep their slot, removed ones leave an empty slot behind,
+// and new ones are appended. Templates are matched by name and category
+// (the n-th duplicate matching the n-th) and compared by content hash.
+struct TemplateDiff {
+    std::vector<uint32_t> removed;                     // slot ids
+    std::vector<std::pair<uint32_t, uint32_t>> updated; // slot id, index in the new list
+    std::vector<uint32_t> added;                       // indices in the new list, in slot order
+    std::vector<uint32_t> order;                       // live slot ids in file order, after applying
+    bool reordered = false;
+
+    bool isEmpty() const { return removed.empty() && updated.empty() && added.empty() && !reordered; }
+
+    // order holds the live slot ids in file order
+    static TemplateDiff compute(const TemplateStore &slots, const std::vector<uint32_t> &order,
+                                const std::vector<Template> &incoming);
+};
+
+#endif // TEMPLATEDIFF_H
@@ -0,0 +1,120 @@
+#include "templateitemdelegate.h"
+#include "templatelistmodel.h"
+#include "templatestore.h"
+#include <QFontMetrics>
+#include <QPainter>
+#include <QStyle>
+#include <algorithm>
+
+namespace {
+const int Padding = 8;  // inside the row, as the old item style sheet
+const int Radius = 4;
+const int MaxCachedRows = 4096; // far more than fit on any screen
+const QColor TextColor(Qt::white);
+const QColor SelectedColor(0x3d, 0xae, 0xe9);
+const QColor HoverColor(61, 174, 233, 100);
+}
+
+TemplateItemDelegate::TemplateItemDelegate(TemplateListModel *model, QObject *parent)
+    : QStyledItemDelegate(parent)
+    , m_model(model)
+    , m_cacheWidth(-1)
+    , m_fontHeight(0)
+{
+    // Slots are renumbered when the whole list is replaced
+    connect(model, &TemplateListModel::templatesReset, this, &TemplateItemDelegate::clearCache);
+}
+
+TemplateItemDelegate::~TemplateItemDelegate() = default;
+
+void TemplateItemDelegate::clearCache()
+{
+    m_cache.clear();
+}
+
+QSize TemplateItemDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    Q_UNUSED(index)
+    return QSize(option.rect.width(), QFontMetrics(option.font).height() + 2 * Padding);
+}
+
+void TemplateItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    const uint32_t id = m_model->templateId(index.row());
+    if (!m_model->templates() || id == TemplateListModel::NoTemplate) {
+        return;
+    }
+
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing);
+    if (option.state & QStyle::State_Selected) {
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(SelectedColor);
+        painter->drawRoundedRect(option.rect, Radius, Radius);
+    } else if (option.state & QStyle::State_MouseOver) {
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(HoverColor);
+        painter->drawRoundedRect(option.rect, Radius, Radius);
+    }
+
+    const RowText &text = rowText(id, *m_model->templates(), option);
+    painter->setFont(option.font);
+    painter->setPen(TextColor);
+    const int top = option.rect.top() + (option.rect.height() - m_fontHeight) / 2;
+    int x = option.rect.left() + Padding;
+    painter->drawStaticText(x, top, text.prefix);
+    x += qRound(text.prefix.size().width());
+    painter->drawStaticText(x, top, text.name);
+    x += qRound(text.name.size().width());
+    painter->drawStaticText(x, top, text.category);
+    painter->restore();
+}
+
+const TemplateItemDelegate::RowText &TemplateItemDelegate::rowText(uint32_t id, const TemplateStore &templates,
+                                                                   const QStyleOptionViewItem &option) const
+{
+    if (option.rect.width() != m_cacheWidth || option.font != m_cacheFont) {
+        m_cache.clear();
+        m_cacheWidth = option.rect.width();
+        m_cacheFont = option.font;
+        m_fontHeight = QFontMetrics(option.font).height();
+    }
+
+    // An update in place may change the shortcut; name and category are
+    // what identifies a slot's template, so they stay
+    const int shortcut = templates.shortcut(id);
+    auto it = m_cache.find(id);
+    if (it != m_cache.end() && it->shortcut == shortcut) {
+        return *it;
+    }
+    if (m_cache.size() >= MaxCachedRows) {
+        m_cache.clear();
+    }
+
+    RowText text;
+    text.shortcut = shortcut;
+    const QFontMetrics metrics(option.font);
+    const std::string_view categoryText = templates.category(id);
+    const std::string_view nameText = templates.name(id);
+    const QString prefix = QString("[%1] ").arg(shortcut);
+    const QString category = categoryText.empty() ? QString()
+        : QString(" (%1)").arg(QString::fromUtf8(categoryText.data(), static_cast<int>(categoryText.size())));
+    const QString name = QString::fromUtf8(nameText.data(), static_cast<int>(nameText.size()));
+
+    // The name gives way first; the category only once the name is gone
+    const int available = option.rect.width() - 2 * Padding - metrics.size(Qt::TextSingleLine, prefix).width();
+    const int categoryWidth = std::min(metrics.size(Qt::TextSingleLine, category).width(), std::max(0, available));
+    text.prefix = prepared(prefix, option.font);
+    text.name = prepared(metrics.elidedText(name, Qt::ElideRight, available - categoryWidth), option.font);
+    text.category = prepared(metrics.elidedText(category, Qt::ElideRight, categoryWidth), option.font);
+    return *m_cache.insert(id, text);
+}
+
+QStaticText TemplateItemDelegate::prepared(const QString &text, const QFont &font) const
+{
+    QStaticText staticText(text);
+    staticText.setTextFormat(Qt::PlainText);
+    staticText.setPerformanceHint(QStaticText::AggressiveCaching);
+    staticText.prepare(QTransform(), font);
+    return staticText;
+}
@@ -0,0 +1,49 @@
+#ifndef TEMPLATEITEMDELEGATE_H
+#define TEMPLATEITEMDELEGATE_H
+
+#include <QFont>
+#include <QHash>
+#include <QStaticText>
+#include <QStyledItemDelegate>
+#include <cstdint>
+
+class TemplateListModel;
+class TemplateStore;
+
+// Paints template rows as "[shortcut] name (category)" without going
+// through the style sheet per item. Rows have a fixed height, and the
+// laid out texts are cached per template (name elided to the row width)
+// so scrolling only draws prepared QStaticText. The cache is dropped when
+// the templates, the width or the font change.
+class TemplateItemDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit TemplateItemDelegate(TemplateListModel *model, QObject *parent = nullptr);
+    ~TemplateItemDelegate();
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+    void clearCache();
+
+private:
+    struct RowText {
+        int shortcut;
+        QStaticText prefix;   // "[1] "
+        QStaticText name;     // elided to fit
+        QStaticText category; // " (category)", may be empty
+    };
+
+    const RowText &rowText(uint32_t id, const TemplateStore &templates, const QStyleOptionViewItem &option) const;
+    QStaticText prepared(const QString &text, const QFont &font) const;
+
+    TemplateListModel *m_model;
+    mutable QHash<uint32_t, RowText> m_cache;
+    mutable int m_cacheWidth;
+    mutable QFont m_cacheFont;
+    mutable int m_fontHeight;
+};
+
+#endif // TEMPLATEITEMDELEGATE_H
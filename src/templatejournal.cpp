@@ -0,0 +1,355 @@
+#include "templatejournal.h"
+#include "hashutil.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <unistd.h>
+
+namespace {
+
+const char JournalMagic[8] = {'C', 'L', 'P', 'T', 'J', 'R', 'N', '1'};
+
+enum Operation : uint8_t {
+    Put = 1,
+    Remove = 2
+};
+
+// Each record is a RecordHeader and then the payload: the operation,
+// the shortcut, and name, category and content, each with its size
+struct RecordHeader {
+    uint32_t size;
+    uint64_t hash; // of the payload
+};
+
+void appendValue(std::string &out, const void *data, size_t size)
+{
+    out.append(static_cast<const char *>(data), size);
+}
+
+void appendString(std::string &out, const std::string &text)
+{
+    const uint32_t size = static_cast<uint32_t>(text.size());
+    appendValue(out, &size, sizeof(size));
+    out += text;
+}
+
+std::string record(Operation operation, const Template &tmpl)
+{
+    std::string payload;
+    const uint8_t op = operation;
+    const int32_t shortcut = tmpl.shortcut;
+    appendValue(payload, &op, sizeof(op));
+    appendValue(payload, &shortcut, sizeof(shortcut));
+    appendString(payload, tmpl.name);
+    appendString(payload, tmpl.category);
+    appendString(payload, operation == Put ? tmpl.content : std::string());
+
+    RecordHeader header;
+    std::memset(&header, 0, sizeof(header)); // no stray padding bytes on disk
+    header.size = static_cast<uint32_t>(payload.size());
+    header.hash = fnv1a64(payload);
+    std::string out;
+    out.reserve(sizeof(header) + payload.size());
+    appendValue(out, &header, sizeof(header));
+    out += payload;
+    return out;
+}
+
+class Reader {
+public:
+    Reader(const char *data, size_t size)
+        : m_data(data)
+        , m_end(data + size)
+    {
+    }
+
+    bool read(void *value, size_t size)
+    {
+        if (static_cast<size_t>(m_end - m_data) < size) {
+            return false;
+        }
+        std::memcpy(value, m_data, size);
+        m_data += size;
+        return true;
+    }
+
+    bool readString(std::string &text)
+    {
+        uint32_t size = 0;
+        if (!read(&size, sizeof(size)) || static_cast<size_t>(m_end - m_data) < size) {
+            return false;
+        }
+        text.assign(m_data, size);
+        m_data += size;
+        return true;
+    }
+
+private:
+    const char *m_data;
+    const char *m_end;
+};
+
+// Applies puts and removes by (name, category) through an index built
+// once, instead of a scan of the whole list per record. Dropped templates
+// are only marked, and cut out in list order by finish().
+class ReplayIndex {
+public:
+    explicit ReplayIndex(std::vector<Template> &templates)
+        : m_templates(templates)
+        , m_dropped(templates.size(), false)
+    {
+        m_positions.reserve(templates.size());
+        for (size_t i = 0; i < templates.size(); ++i) {
+            m_positions[key(templates[i].name, templates[i].category)].push_back(i);
+        }
+    }
+
+    // Duplicates collapse into the first, so applying a put twice is a no-op
+    void put(const Template &tmpl)
+    {
+        std::vector<size_t> &positions = m_positions[key(tmpl.name, tmpl.category)];
+        if (positions.empty()) {
+            positions.push_back(m_templates.size());
+            m_templates.push_back(tmpl);
+            m_dropped.push_back(false);
+            return;
+        }
+        m_templates[positions.front()] = tmpl;
+        for (size_t i = 1; i < positions.size(); ++i) {
+            m_dropped[positions[i]] = true;
+        }
+        positions.resize(1);
+    }
+
+    void remove(const std::string &name, const std::string &category)
+    {
+        auto it = m_positions.find(key(name, category));
+        if (it == m_positions.end()) {
+            return;
+        }
+        for (size_t position : it->second) {
+            m_dropped[position] = true;
+        }
+        it->second.clear();
+    }
+
+    void finish()
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < m_templates.size(); ++i) {
+            if (!m_dropped[i]) {
+                if (kept != i) {
+                    m_templates[kept] = std::move(m_templates[i]);
+                }
+                ++kept;
+            }
+        }
+        m_templates.resize(kept);
+    }
+
+private:
+    static std::string key(const std::string &name, const std::string &category)
+    {
+        std::string joined;
+        joined.reserve(name.size() + 1 + category.size());
+        joined += name;
+        joined += '\0';
+        joined += category;
+        return joined;
+    }
+
+    std::vector<Template> &m_templates;
+    std::vector<bool> m_dropped;
+    std::unordered_map<std::string, std::vector<size_t>> m_positions; // live ones, in list order
+};
+
+} // namespace
+
+TemplateJournal::TemplateJournal(const std::string &yamlPath)
+    : m_validated(false)
+{
+    const QFileInfo yaml(QString::fromStdString(yamlPath));
+    m_path = (yaml.absolutePath() + "/" + yaml.completeBaseName() + ".journal").toStdString();
+    m_compactingPath = m_path + ".compacting";
+}
+
+TemplateJournal::~TemplateJournal() = default;
+
+bool TemplateJournal::appendPut(const Template &tmpl)
+{
+    return append(record(Put, tmpl));
+}
+
+bool TemplateJournal::appendRemove(const std::string &name, const std::string &category)
+{
+    Template tmpl;
+    tmpl.name = name;
+    tmpl.category = category;
+    return append(record(Remove, tmpl));
+}
+
+bool TemplateJournal::append(const std::string &record)
+{
+    if (!m_validated) {
+        // Left by a crash mid-append; cut back to the last intact record
+        qint64 valid = 0;
+        replayFile(m_path, nullptr, &valid);
+        const QFileInfo journal(QString::fromStdString(m_path));
+        if (journal.exists() && journal.size() != valid) {
+            qDebug() << "[clip-template] Cutting template journal" << journal.filePath() << "back to" << valid << "bytes";
+            if (!QFile::resize(journal.filePath(), valid)) {
+                qDebug() << "[clip-template] Cannot truncate template journal" << journal.filePath();
+                return false;
+            }
+        }
+        m_validated = true;
+    }
+
+    QFile file(QString::fromStdString(m_path));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qDebug() << "[clip-template] Cannot open template journal" << file.fileName();
+        return false;
+    }
+
+    // A new journal gets its magic in the same write as the first record
+    std::string out;
+    if (file.size() == 0) {
+        out.assign(JournalMagic, sizeof(JournalMagic));
+    }
+    out += record;
+
+    const bool written = file.write(out.data(), static_cast<qint64>(out.size())) == static_cast<qint64>(out.size()) &&
+                         file.flush() && ::fdatasync(file.handle()) == 0;
+    if (!written) {
+        qDebug() << "[clip-template] Failed to write template journal" << file.fileName();
+        m_validated = false; // part of the record may have landed
+    }
+    return written;
+}
+
+bool TemplateJournal::replay(std::vector<Template> &templates) const
+{
+    const bool compacting = replayFile(m_compactingPath, &templates);
+    const bool journal = replayFile(m_path, &templates);
+    return compacting || journal;
+}
+
+bool TemplateJournal::replayCompaction(std::vector<Template> &templates) const
+{
+    return replayFile(m_compactingPath, &templates);
+}
+
+bool TemplateJournal::replayFile(const std::string &path, std::vector<Template> *templates, qint64 *validSize)
+{
+    if (validSize) {
+        *validSize = 0;
+    }
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::ReadOnly) || file.size() < static_cast<qint64>(sizeof(JournalMagic))) {
+        return false;
+    }
+    const uchar *mapped = file.map(0, file.size());
+    if (!mapped) {
+        return false;
+    }
+    const char *data = reinterpret_cast<const char *>(mapped);
+    const size_t size = static_cast<size_t>(file.size());
+    if (std::memcmp(data, JournalMagic, sizeof(JournalMagic)) != 0) {
+        qDebug() << "[clip-template] Ignoring unreadable template journal" << file.fileName();
+        file.unmap(const_cast<uchar *>(mapped));
+        return false;
+    }
+
+    std::unique_ptr<ReplayIndex> index; // built at the first record
+    bool applied = false;
+    size_t offset = sizeof(JournalMagic);
+    size_t valid = offset;
+    while (offset < size) {
+        RecordHeader header;
+        if (size - offset < sizeof(header)) {
+            break;
+        }
+        std::memcpy(&header, data + offset, sizeof(header));
+        offset += sizeof(header);
+        // A torn record can only be the last one
+        if (size - offset < header.size || fnv1a64(data + offset, header.size) != header.hash) {
+            qDebug() << "[clip-template] Template journal ends in an incomplete record; ignored.";
+            break;
+        }
+
+        Reader reader(data + offset, header.size);
+        offset += header.size;
+        uint8_t op = 0;
+        int32_t shortcut = 0;
+        Template tmpl;
+        if (!reader.read(&op, sizeof(op)) || !reader.read(&shortcut, sizeof(shortcut)) ||
+            !reader.readString(tmpl.name) || !reader.readString(tmpl.category) || !reader.readString(tmpl.content)) {
+            break;
+        }
+        tmpl.shortcut = shortcut;
+        valid = offset;
+
+        if (!templates) {
+            continue;
+        }
+        if (!index) {
+            index = std::make_unique<ReplayIndex>(*templates);
+        }
+        if (op == Put) {
+            index->put(tmpl);
+        } else if (op == Remove) {
+            index->remove(tmpl.name, tmpl.category);
+        }
+        applied = true;
+    }
+    if (index) {
+        index->finish();
+    }
+
+    file.unmap(const_cast<uchar *>(mapped));
+    if (validSize) {
+        *validSize = static_cast<qint64>(valid);
+    }
+    return applied;
+}
+
+bool TemplateJournal::isEmpty() const
+{
+    return size() == 0;
+}
+
+long long TemplateJournal::size() const
+{
+    const QFileInfo journal(QString::fromStdString(m_path));
+    const QFileInfo compacting(QString::fromStdString(m_compactingPath));
+    return (journal.exists() ? journal.size() : 0) + (compacting.exists() ? compacting.size() : 0);
+}
+
+bool TemplateJournal::beginCompaction()
+{
+    // An aside journal from a crashed compaction is compacted as it is;
+    // the current one waits for the next round
+    if (QFile::exists(QString::fromStdString(m_compactingPath))) {
+        return true;
+    }
+    if (!QFile::exists(QString::fromStdString(m_path))) {
+        return false;
+    }
+    return ::rename(m_path.c_str(), m_compactingPath.c_str()) == 0;
+}
+
+void TemplateJournal::finishCompaction()
+{
+    QFile::remove(QString::fromStdString(m_compactingPath));
+}
+
+void TemplateJournal::clear()
+{
+    QFile::remove(QString::fromStdString(m_compactingPath));
+    QFile::remove(QString::fromStdString(m_path));
+}
@@ -0,0 +1,58 @@
+#ifndef TEMPLATEJOURNAL_H
+#define TEMPLATEJOURNAL_H
+
+#include <QtGlobal>
+#include <string>
+#include <vector>
+#include "templatemanager.h"
+
+// Append-only log of single-template edits to a templates.yaml, kept
+// next to it as templates.journal, so that saving one change costs one
+// small write instead of rewriting the whole library.
+//
+// Each record puts (adds or replaces) or removes the templates with a
+// given name and category, and carries its size and hash so a record torn
+// by a crash ends the replay instead of corrupting it. Replaying records
+// again over a file they were already applied to gives the same result,
+// which is what makes compaction crash-safe: the journal is renamed aside,
+// merged into the YAML (written by atomic rename), and only then deleted.
+// Before the first append a torn record is cut off, so that later records
+// are not written behind it where no replay would reach them.
+class TemplateJournal {
+public:
+    explicit TemplateJournal(const std::string &yamlPath);
+    ~TemplateJournal();
+
+    const std::string &path() const { return m_path; }
+
+    // Appended and synced to disk before returning
+    bool appendPut(const Template &tmpl);
+    bool appendRemove(const std::string &name, const std::string &category);
+
+    // Applies the edits of an interrupted compaction and then the journal;
+    // put templates come without search keys. False if there were none.
+    bool replay(std::vector<Template> &templates) const;
+    bool isEmpty() const;
+    long long size() const;
+
+    // Moves the journal aside for compaction; later edits start a new one.
+    // An aside journal left by a crash is compacted first.
+    bool beginCompaction();
+    bool replayCompaction(std::vector<Template> &templates) const;
+    void finishCompaction();
+
+    // Drops every edit, once the whole list was saved
+    void clear();
+
+private:
+    bool append(const std::string &record);
+    // Applies the records of path to templates, if given, and reports where
+    // the last intact one ends; 0 for a missing or foreign file
+    static bool replayFile(const std::string &path, std::vector<Template> *templates, qint64 *validSize = nullptr);
+
+    std::string m_path;
+    std::string m_compactingPath;
+    bool m_validated; // the journal's tail was checked by this process
+};
+
+#endif // TEMPLATEJOURNAL_H
@@ -0,0 +1,83 @@
+#include "templatelistmodel.h"
+#include <algorithm>
+#include <numeric>
+
+TemplateListModel::TemplateListModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_templates(nullptr)
+{
+}
+
+TemplateListModel::~TemplateListModel() = default;
+
+void TemplateListModel::setTemplates(const TemplateStore &templates)
+{
+    beginResetModel();
+    m_templates = &templates;
+    m_rows.resize(templates.size());
+    std::iota(m_rows.begin(), m_rows.end(), 0u);
+    endResetModel();
+    emit templatesReset();
+}
+
+bool TemplateListModel::setRows(std::vector<uint32_t> rows)
+{
+    if (rows == m_rows) {
+        return false;
+    }
+
+    beginResetModel();
+    m_rows = std::move(rows);
+    endResetModel();
+    return true;
+}
+
+void TemplateListModel::refresh()
+{
+    if (!m_rows.empty()) {
+        emit dataChanged(index(0), index(static_cast<int>(m_rows.size()) - 1));
+    }
+}
+
+uint32_t TemplateListModel::templateId(int row) const
+{
+    if (row < 0 || row >= static_cast<int>(m_rows.size())) {
+        return NoTemplate;
+    }
+    return m_rows[row];
+}
+
+int TemplateListModel::rowOf(uint32_t id) const
+{
+    auto it = std::find(m_rows.begin(), m_rows.end(), id);
+    return it == m_rows.end() ? -1 : static_cast<int>(it - m_rows.begin());
+}
+
+int TemplateListModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return static_cast<int>(m_rows.size());
+}
+
+QVariant TemplateListModel::data(const QModelIndex &index, int role) const
+{
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    const uint32_t id = templateId(index.row());
+    if (!m_templates || id == NoTemplate) {
+        return QVariant();
+    }
+
+    const std::string_view name = m_templates->name(id);
+    const std::string_view category = m_templates->category(id);
+    const QString nameText = QString::fromUtf8(name.data(), static_cast<int>(name.size()));
+    if (category.empty()) {
+        return QString("[%1] %2").arg(m_templates->shortcut(id)).arg(nameText);
+    }
+    return QString("[%1] %2 (%3)").arg(m_templates->shortcut(id)).arg(nameText)
+        .arg(QString::fromUtf8(category.data(), static_cast<int>(category.size())));
+}
@@ -0,0 +1,49 @@
+#ifndef TEMPLATELISTMODEL_H
+#define TEMPLATELISTMODEL_H
+
+#include <QAbstractListModel>
+#include <cstdint>
+#include <vector>
+#include "templatestore.h"
+
+// List model over the loaded templates. Filtering only swaps the row
+// mapping; display text is formatted lazily for the rows the view asks for.
+class TemplateListModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    explicit TemplateListModel(QObject *parent = nullptr);
+    ~TemplateListModel();
+
+    // Show every template; the store must outlive the model or be replaced
+    void setTemplates(const TemplateStore &templates);
+    const TemplateStore *templates() const { return m_templates; }
+
+    static const uint32_t NoTemplate = 0xFFFFFFFFu;
+
+    // Show only the given template indices, in the given order. Returns
+    // false, leaving the view untouched, if the rows did not change.
+    bool setRows(std::vector<uint32_t> rows);
+
+    // Repaint every row after templates changed in place
+    void refresh();
+
+    // NoTemplate if the row does not exist
+    uint32_t templateId(int row) const;
+    // -1 if the template is not shown
+    int rowOf(uint32_t id) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+signals:
+    // setTemplates() replaced the list; template ids may mean other templates
+    void templatesReset();
+
+private:
+    const TemplateStore *m_templates;
+    std::vector<uint32_t> m_rows;
+};
+
+#endif // TEMPLATELISTMODEL_H
@@ -0,0 +1,110 @@
+#include "templateloader.h"
+#include <QRunnable>
+
+namespace {
+
+// Templates in the first batch: enough for the first screenful
+const size_t FirstBatchSize = 32;
+
+class LoadTask : public QRunnable
+{
+public:
+    explicit LoadTask(std::function<void()> work) : m_work(std::move(work)) {}
+    void run() override { m_work(); }
+
+private:
+    std::function<void()> m_work;
+};
+
+} // namespace
+
+TemplateLoader::TemplateLoader(TemplateManager *manager, QObject *parent)
+    : QObject(parent)
+    , m_manager(manager)
+    , m_cancelled(false)
+    , m_loading(false)
+    , m_generation(0)
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+TemplateLoader::~TemplateLoader()
+{
+    cancel();
+}
+
+void TemplateLoader::start(const std::vector<std::string> &sources)
+{
+    run(sources, false);
+}
+
+void TemplateLoader::reload(const std::vector<std::string> &sources)
+{
+    run(sources, true);
+}
+
+void TemplateLoader::run(const std::vector<std::string> &sources, bool whole)
+{
+    cancel();
+    m_cancelled = false;
+    m_loading = true;
+    const quint64 generation = ++m_generation;
+
+    m_pool.start(new LoadTask([this, sources, generation, whole]() {
+        auto onBatch = [this, whole](std::vector<Template> &batch) {
+            if (m_cancelled) {
+                return false;
+            }
+
+            bool wasEmpty = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                wasEmpty = m_loaded.empty();
+                if (wasEmpty) {
+                    m_loaded.swap(batch);
+                } else {
+                    std::move(batch.begin(), batch.end(), std::back_inserter(m_loaded));
+                }
+            }
+            // One notification until the GUI thread has taken the templates
+            if (wasEmpty && !whole) {
+                QMetaObject::invokeMethod(this, "templatesAvailable", Qt::QueuedConnection);
+            }
+            return true;
+        };
+        const bool complete = m_manager->streamTemplates(sources, FirstBatchSize, onBatch);
+
+        if (!m_cancelled) {
+            QMetaObject::invokeMethod(this, [this, complete, generation, whole]() {
+                if (generation != m_generation) {
+                    return;
+                }
+                m_loading = false;
+                if (whole) {
+                    emit reloaded(complete);
+                } else {
+                    emit finished(complete);
+                }
+            }, Qt::QueuedConnection);
+        }
+    }));
+}
+
+void TemplateLoader::cancel()
+{
+    m_cancelled = true;
+    m_pool.waitForDone();
+    m_loading = false;
+    ++m_generation;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_loaded.clear();
+}
+
+std::vector<Template> TemplateLoader::takeLoaded()
+{
+    std::vector<Template> loaded;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    loaded.swap(m_loaded);
+    return loaded;
+}
@@ -0,0 +1,57 @@
+#ifndef TEMPLATELOADER_H
+#define TEMPLATELOADER_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "templatemanager.h"
+
+// Reads the template sources on a worker thread and hands the templates
+// to the GUI thread in batches while reading continues, so the first rows
+// appear long before a large library has been read. A single file is
+// parsed progressively, with a small first batch and growing later ones;
+// several files arrive one file at a time, in merge order.
+//
+// A reload reads the sources the same way but hands the templates over
+// only once all of them are read, for diffing against the loaded set.
+class TemplateLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TemplateLoader(TemplateManager *manager, QObject *parent = nullptr);
+    ~TemplateLoader();
+
+    void start(const std::vector<std::string> &sources);
+    // Read every source; reloaded() follows and takeLoaded() returns them all
+    void reload(const std::vector<std::string> &sources);
+    // Stop the running load and wait for it
+    void cancel();
+    bool isLoading() const { return m_loading; }
+
+    // Templates parsed since the last call, in file order
+    std::vector<Template> takeLoaded();
+
+signals:
+    // Queued; takeLoaded() returns the new templates
+    void templatesAvailable();
+    void finished(bool complete);
+    // Queued; complete is false when a source could not be read in full
+    void reloaded(bool complete);
+
+private:
+    void run(const std::vector<std::string> &sources, bool whole);
+
+    TemplateManager *m_manager;
+    QThreadPool m_pool;
+    std::mutex m_mutex;
+    std::vector<Template> m_loaded; // guarded by m_mutex
+    std::atomic<bool> m_cancelled;
+    bool m_loading;
+    quint64 m_generation; // GUI thread only; drops a finish from a cancelled load
+};
+
+#endif // TEMPLATELOADER_H
@@ -1,48 +1,406 @@
 #include "templatemanager.h"
 #include "configreader.h"
+#include "templatecache.h"
+#include "searchfold.h"
+#include "placeholders.h"
+#include "templatejournal.h"
+#include "templatestore.h"
+#include "trace.h"
 #include <QDir>
 #include <QStandardPaths>
 #include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include <fstream>
+#include <future>
+#include <iterator>
+#include <map>
+#include <system_error>
+#include <thread>
+
+namespace {
+// Journal size that triggers merging it into the YAML
+const long long CompactThreshold = 64 * 1024;
+}
 
 TemplateManager::TemplateManager()
 {
     m_configPath = getConfigPath();
+    m_journal = std::make_unique<TemplateJournal>(userConfigFile());
 }
 
-TemplateManager::~TemplateManager() = default;
+TemplateManager::~TemplateManager()
+{
+    if (m_compaction.valid()) {
+        m_compaction.wait();
+    }
+}
 
 std::vector<Template> TemplateManager::loadTemplates()
 {
+    TraceScope trace("TemplateManager::loadTemplates");
+    std::vector<Template> templates;
+    readSources(configSources(), [&templates](std::vector<Template> &file) {
+        if (templates.empty()) {
+            templates.swap(file);
+        } else {
+            std::move(file.begin(), file.end(), std::back_inserter(templates));
+        }
+        return true;
+    });
+    return templates;
+}
+
+std::vector<std::string> TemplateManager::configSources()
+{
+    TraceScope trace("TemplateManager::configSources");
+    std::vector<std::string> sources;
+    const std::vector<std::string> layers = configLayers();
+
+    for (const auto &layer : layers) {
+        std::string configFile = layer + "/templates.yaml";
+        if (QFile::exists(QString::fromStdString(configFile))) {
+            sources.push_back(configFile);
+            break;
+        }
+    }
+
+    // Drop-in files by name; lower layers never replace a name already taken
+    std::map<std::string, std::string> dropIns;
+    for (const auto &layer : layers) {
+        QDir dir(QString::fromStdString(layer + "/templates.d"));
+        const QStringList files = dir.entryList({"*.yaml", "*.yml"}, QDir::Files | QDir::Readable, QDir::Name);
+        for (const QString &file : files) {
+            dropIns.emplace(file.toStdString(), dir.filePath(file).toStdString());
+        }
+    }
+    for (const auto &dropIn : dropIns) {
+        sources.push_back(dropIn.second);
+    }
+
+    return sources;
+}
+
+std::vector<std::string> TemplateManager::configDirectories()
+{
+    std::vector<std::string> directories = {m_configPath};
+    for (const auto &layer : configLayers()) {
+        const std::string dropInDir = layer + "/templates.d";
+        if (QDir(QString::fromStdString(dropInDir)).exists()) {
+            directories.push_back(dropInDir);
+        }
+    }
+    return directories;
+}
+
+std::string TemplateManager::userConfigFile() const
+{
+    return m_configPath + "/templates.yaml";
+}
+
+std::vector<std::string> TemplateManager::configLayers() const
+{
+    // Highest precedence first: user, system, local
+    return {m_configPath, "/usr/share/clip-template", "config"};
+}
+
+std::vector<Template> TemplateManager::readTemplates(const std::string &filepath)
+{
+    TraceScope trace("TemplateManager::readTemplates");
+    trace.setDetail(filepath);
+    // The compiled cache skips YAML parsing entirely while the file is unchanged
+    TemplateCache cache;
+    std::vector<Template> templates;
+    if (cache.load(filepath, templates)) {
+        applyJournal(filepath, templates);
+        return templates;
+    }
+
+    // A file that does not parse shows no templates until it is fixed
     ConfigReader reader;
-    
-    // Try user config first
-    std::string userConfig = m_configPath + "/templates.yaml";
-    if (QFile::exists(QString::fromStdString(userConfig))) {
-        return reader.readConfig(userConfig);
+    reader.readConfig(filepath, templates);
+    for (auto &tmpl : templates) {
+        tmpl.searchKey = SearchFold::searchKey(tmpl);
+        Placeholders::compile(tmpl);
     }
-    
-    // Try system config
-    std::string systemConfig = "/usr/share/clip-template/templates.yaml";
-    if (QFile::exists(QString::fromStdString(systemConfig))) {
-        return reader.readConfig(systemConfig);
+    if (!templates.empty()) {
+        cache.store(filepath, templates);
     }
-    
-    // Try local config
-    std::string localConfig = "config/templates.yaml";
-    if (QFile::exists(QString::fromStdString(localConfig))) {
-        return reader.readConfig(localConfig);
+    // The cache holds the YAML alone; edits since are on top
+    applyJournal(filepath, templates);
+    return templates;
+}
+
+void TemplateManager::applyJournal(const std::string &filepath, std::vector<Template> &templates)
+{
+    if (filepath != userConfigFile()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_journalMutex);
+    if (!m_journal->replay(templates)) {
+        return;
+    }
+    for (auto &tmpl : templates) {
+        if (tmpl.searchKey.empty()) {
+            tmpl.searchKey = SearchFold::searchKey(tmpl);
+            Placeholders::compile(tmpl);
+        }
     }
-    
-    // Return empty vector if no config found
-    return std::vector<Template>();
+}
+
+bool TemplateManager::readSources(const std::vector<std::string> &sources, const BatchCallback &onFile)
+{
+    // Files are read (each from its own cache when current) by a few
+    // workers, and handed over in source order on this thread as soon
+    // as every file before them is done
+    std::vector<std::promise<std::vector<Template>>> results(sources.size());
+    std::vector<std::future<std::vector<Template>>> done;
+    for (auto &result : results) {
+        done.push_back(result.get_future());
+    }
+    std::atomic<size_t> next(0);
+    std::atomic<bool> stopped(false);
+    auto work = [&]() {
+        for (size_t i = next++; i < sources.size(); i = next++) {
+            // An escaping exception would leave this file's promise, and
+            // the GUI thread waiting on it, unresolved
+            try {
+                results[i].set_value(stopped ? std::vector<Template>() : readTemplates(sources[i]));
+            } catch (...) {
+                results[i].set_exception(std::current_exception());
+            }
+        }
+    };
+
+    const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::future<void>> workers;
+    for (size_t i = 0; i < std::min(threads, sources.size()); ++i) {
+        try {
+            workers.push_back(std::async(std::launch::async, work));
+        } catch (const std::system_error &) {
+            break; // out of threads; the ones started take the rest
+        }
+    }
+    if (workers.empty()) {
+        work();
+    }
+
+    for (size_t i = 0; i < done.size(); ++i) {
+        std::vector<Template> templates;
+        try {
+            templates = done[i].get();
+        } catch (const std::exception &e) {
+            qDebug() << "[clip-template] Cannot read" << QString::fromStdString(sources[i]) << ":" << e.what();
+        } catch (...) {
+            qDebug() << "[clip-template] Cannot read" << QString::fromStdString(sources[i]);
+        }
+        if (!stopped && !templates.empty() && !onFile(templates)) {
+            stopped = true;
+        }
+    }
+    for (auto &worker : workers) {
+        worker.get();
+    }
+    return !stopped;
+}
+
+bool TemplateManager::loadCachedTemplates(const std::vector<std::string> &sources, TemplateStore &templates)
+{
+    TraceScope trace("TemplateManager::loadCachedTemplates");
+    templates.clear();
+    TemplateCache cache;
+    for (const auto &source : sources) {
+        bool loaded = false;
+        if (source == userConfigFile() && !m_journal->isEmpty()) {
+            // Journal edits replace whole templates, so they go through
+            // a list first
+            std::vector<Template> file;
+            loaded = cache.load(source, file);
+            if (loaded) {
+                applyJournal(source, file);
+                for (const auto &tmpl : file) {
+                    templates.append(tmpl);
+                }
+            }
+        } else {
+            loaded = cache.load(source, templates);
+        }
+        if (!loaded) {
+            templates.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TemplateManager::streamTemplates(const std::vector<std::string> &sources, size_t firstBatchSize,
+                                      const BatchCallback &onBatch)
+{
+    TraceScope trace("TemplateManager::streamTemplates");
+    // Journal edits can change any template, so they need the whole file
+    if (sources.size() != 1 || (sources.front() == userConfigFile() && !m_journal->isEmpty())) {
+        return readSources(sources, onBatch);
+    }
+
+    // A single large file is parsed progressively instead. A copy is kept
+    // for the cache, which is written once the file is complete
+    const std::string &filepath = sources.front();
+    std::vector<Template> all;
+    ConfigReader reader;
+    const bool complete = reader.readConfigStreaming(filepath, firstBatchSize, [&](std::vector<Template> &batch) {
+        for (auto &tmpl : batch) {
+            tmpl.searchKey = SearchFold::searchKey(tmpl);
+            Placeholders::compile(tmpl);
+        }
+        all.insert(all.end(), batch.begin(), batch.end());
+        return onBatch(batch);
+    });
+
+    if (complete && !all.empty()) {
+        TemplateCache cache;
+        cache.store(filepath, all);
+    }
+    return complete;
 }
 
 bool TemplateManager::saveTemplates(const std::vector<Template> &templates)
 {
+    TraceScope trace("TemplateManager::saveTemplates");
+    // A compaction finishing later would write back an older list
+    if (m_compaction.valid()) {
+        m_compaction.wait();
+    }
+
+    std::lock_guard<std::mutex> lock(m_journalMutex);
+    ConfigReader reader;
+    if (!reader.writeConfig(userConfigFile(), templates)) {
+        return false;
+    }
+    m_journal->clear(); // the list already has every edit
+    return true;
+}
+
+bool TemplateManager::addTemplate(const Template &tmpl)
+{
+    return updateTemplate(tmpl.name, tmpl.category, tmpl);
+}
+
+bool TemplateManager::updateTemplate(const std::string &name, const std::string &category, const Template &tmpl)
+{
+    TraceScope trace("TemplateManager::updateTemplate");
+    {
+        std::lock_guard<std::mutex> lock(m_journalMutex);
+        if (!ensureUserConfig()) {
+            return false;
+        }
+        // The new one first: a crash in between leaves both, never neither
+        if (!m_journal->appendPut(tmpl)) {
+            return false;
+        }
+        if ((name != tmpl.name || category != tmpl.category) && !m_journal->appendRemove(name, category)) {
+            return false;
+        }
+    }
+    compactJournalLater();
+    return true;
+}
+
+bool TemplateManager::removeTemplate(const std::string &name, const std::string &category)
+{
+    TraceScope trace("TemplateManager::removeTemplate");
+    {
+        std::lock_guard<std::mutex> lock(m_journalMutex);
+        if (!ensureUserConfig() || !m_journal->appendRemove(name, category)) {
+            return false;
+        }
+    }
+    compactJournalLater();
+    return true;
+}
+
+std::string TemplateManager::journalPath() const
+{
+    return m_journal->path();
+}
+
+bool TemplateManager::ensureUserConfig()
+{
+    const std::string userConfig = userConfigFile();
+    if (QFile::exists(QString::fromStdString(userConfig))) {
+        return true;
+    }
+
+    // Edits go to the user layer, which then shadows the templates.yaml
+    // that was in use; start from its contents. One that does not parse
+    // would seed an empty library, so the edit fails instead
+    std::vector<Template> templates;
+    for (const auto &source : configSources()) {
+        if (QFileInfo(QString::fromStdString(source)).fileName() == "templates.yaml") {
+            if (!ConfigReader().readConfig(source, templates)) {
+                qDebug() << "[clip-template] Cannot start the user's templates from" << QString::fromStdString(source);
+                return false;
+            }
+            break;
+        }
+    }
+    return ConfigReader().writeConfig(userConfig, templates);
+}
+
+void TemplateManager::compactJournalLater()
+{
+    if (m_journal->size() < CompactThreshold) {
+        return;
+    }
+    if (m_compaction.valid() && m_compaction.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return; // the running one leaves the rest for the next edit
+    }
+    m_compaction = std::async(std::launch::async, [this]() { compactJournal(); });
+}
+
+void TemplateManager::compactJournal()
+{
+    TraceScope trace("TemplateManager::compactJournal");
+    {
+        std::lock_guard<std::mutex> lock(m_journalMutex);
+        if (!m_journal->beginCompaction()) {
+            return;
+        }
+    }
+
+    // Edits made meanwhile go to a new journal and stay there. Until the
+    // aside journal is deleted, loading applies it again, which is harmless
+    const std::string userConfig = userConfigFile();
+    ConfigReader reader;
+    std::vector<Template> templates;
+    if (!reader.readConfig(userConfig, templates)) {
+        // Merging into an unreadable file (say, mid hand-edit) would
+        // replace the library with the journaled templates alone; the
+        // aside journal stays and is merged by a later compaction
+        qDebug() << "[clip-template] Cannot read" << QString::fromStdString(userConfig) << "; journal not merged.";
+        return;
+    }
+    m_journal->replayCompaction(templates);
+    if (reader.writeConfig(userConfig, templates)) {
+        m_journal->finishCompaction();
+        qDebug() << "[clip-template] Merged the template journal into" << QString::fromStdString(userConfig);
+    }
+}
+
+Settings TemplateManager::loadSettings()
+{
+    TraceScope trace("TemplateManager::loadSettings");
+    std::string settingsFile = m_configPath + "/settings.yaml";
+    if (!QFile::exists(QString::fromStdString(settingsFile))) {
+        return Settings();
+    }
+    
     ConfigReader reader;
-    std::string userConfig = m_configPath + "/templates.yaml";
-    return reader.writeConfig(userConfig, templates);
+    return reader.readSettings(settingsFile);
 }
 
 std::string TemplateManager::getConfigPath()
@@ -1,14 +1,40 @@
 #ifndef TEMPLATEMANAGER_H
 #define TEMPLATEMANAGER_H
 
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
+#include "settings.h"
+
+class TemplateJournal;
+class TemplateStore;
+
+// A literal run or a placeholder of Template::content, see Placeholders
+struct TemplateSegment {
+    enum Kind : uint8_t {
+        Literal,
+        Date,
+        Clipboard,
+        Env,
+        Cursor
+    };
+
+    Kind kind;
+    uint32_t offset; // the literal text, or the placeholder's argument,
+    uint32_t size;   // within content
+};
 
 struct Template {
     std::string name;
     std::string content;
     std::string category;
     int shortcut;
+    std::string searchKey; // folded name/category/content, see SearchFold
+    std::vector<TemplateSegment> segments; // empty without placeholders
     
     Template() : shortcut(0) {}
 };
@@ -18,12 +44,56 @@ public:
     TemplateManager();
     ~TemplateManager();
     
+    using BatchCallback = std::function<bool(std::vector<Template> &)>;
+
+    // Every source, merged in configSources() order
     std::vector<Template> loadTemplates();
+
+    // The files templates are read from, in merge order: the first
+    // templates.yaml found (user, system, local), then the *.yaml files
+    // of the templates.d directories by file name. A file in the user
+    // layer replaces one of the same name in the system layer, which
+    // replaces one in the local layer.
+    std::vector<std::string> configSources();
+    // Directories whose changes can change configSources()
+    std::vector<std::string> configDirectories();
+
+    // The two halves of loadTemplates() for progressive loading: every
+    // source from its compiled cache, straight into the store, if all are
+    // current, else a load that hands over batches (with search keys) in
+    // merge order as they are read, refreshing the caches.
+    // streamTemplates() may run on any thread.
+    bool loadCachedTemplates(const std::vector<std::string> &sources, TemplateStore &templates);
+    bool streamTemplates(const std::vector<std::string> &sources, size_t firstBatchSize, const BatchCallback &onBatch);
+    // Replaces the user's templates.yaml with the whole list
     bool saveTemplates(const std::vector<Template> &templates);
+
+    // Single edits to the user's templates.yaml, identified by name and
+    // category. They only append to its journal (see TemplateJournal),
+    // which is merged into the YAML in the background once it grows.
+    bool addTemplate(const Template &tmpl);
+    bool updateTemplate(const std::string &name, const std::string &category, const Template &tmpl);
+    bool removeTemplate(const std::string &name, const std::string &category);
+    // Changes to it change the loaded templates, like configSources()
+    std::string journalPath() const;
+
+    Settings loadSettings();
     
 private:
     std::string getConfigPath();
+    std::string userConfigFile() const;
+    std::vector<std::string> configLayers() const;
+    std::vector<Template> readTemplates(const std::string &filepath);
+    bool readSources(const std::vector<std::string> &sources, const BatchCallback &onFile);
+    void applyJournal(const std::string &filepath, std::vector<Template> &templates);
+    bool ensureUserConfig(); // with m_journalMutex held, like the other writers
+    void compactJournalLater();
+    void compactJournal();
+
     std::string m_configPath;
+    std::unique_ptr<TemplateJournal> m_journal;
+    std::mutex m_journalMutex; // the user file and its journal
+    std::future<void> m_compaction;
 };
 
 #endif // TEMPLATEMANAGER_H
\ No newline at end of file
@@ -0,0 +1,258 @@
+#include "templatepreview.h"
+#include <QEvent>
+#include <QFontMetrics>
+#include <QPainter>
+#include <QScrollBar>
+#include <QTimer>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace {
+const int BlockLines = 128;
+// Longer lines are cut when decoding, so even a template that is one
+// multi-megabyte line decodes to a short string
+const size_t MaxLineBytes = 4096;
+const int MaxLineChars = 1024;
+// Searched for line breaks per event loop turn
+const size_t IndexSlice = 1 << 20;
+// In decoded characters; a full block costs about an eighth of it, so
+// one never fails to fit
+const int MaxCachedChars = 1 << 20;
+const int Padding = 8;
+}
+
+TemplatePreview::TemplatePreview(QWidget *parent)
+    : QAbstractScrollArea(parent)
+    , m_lineStarts(1, 0)
+    , m_indexed(0)
+    , m_indexTimer(new QTimer(this))
+    , m_blocks(MaxCachedChars)
+    , m_maxWidth(0)
+{
+    // Arrow keys stay with the template list
+    setFocusPolicy(Qt::NoFocus);
+    m_indexTimer->setInterval(0);
+    connect(m_indexTimer, &QTimer::timeout, this, &TemplatePreview::indexMore);
+}
+
+TemplatePreview::~TemplatePreview() = default;
+
+void TemplatePreview::setContent(std::string_view content)
+{
+    if (content.data() == m_content.data() && content.size() == m_content.size()) {
+        return;
+    }
+
+    m_content = content;
+    m_lineStarts.assign(1, 0);
+    m_indexed = 0;
+    m_maxWidth = 0;
+    verticalScrollBar()->setValue(0);
+    horizontalScrollBar()->setValue(0);
+
+    // The first page now, the rest of the line breaks in the background
+    indexTo(static_cast<size_t>(viewport()->height() / fontMetrics().lineSpacing() + 1));
+    if (isIndexed()) {
+        m_indexTimer->stop();
+    } else {
+        m_indexTimer->start();
+    }
+    updateScrollBars();
+    viewport()->update();
+}
+
+void TemplatePreview::reset()
+{
+    m_indexTimer->stop();
+    m_content = std::string_view();
+    m_lineStarts.assign(1, 0);
+    m_indexed = 0;
+    m_blocks.clear();
+    m_maxWidth = 0;
+    updateScrollBars();
+    viewport()->update();
+}
+
+void TemplatePreview::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event)
+    if (m_content.empty()) {
+        return;
+    }
+
+    QPainter painter(viewport());
+    painter.setFont(font());
+    painter.setPen(palette().color(QPalette::Text));
+    const QFontMetrics metrics = fontMetrics();
+    const int lineHeight = metrics.lineSpacing();
+    const size_t first = static_cast<size_t>(verticalScrollBar()->value());
+    const size_t end = first + static_cast<size_t>(viewport()->height() / lineHeight + 1);
+    indexTo(end);
+
+    const int x = Padding - horizontalScrollBar()->value();
+    int y = Padding + metrics.ascent();
+    const int maxWidth = m_maxWidth;
+    const size_t lines = std::min(knownLines(), end);
+    for (size_t line = first; line < lines;) {
+        const size_t index = line / BlockLines;
+        const Block *decoded = block(index);
+        const size_t blockFirst = index * BlockLines;
+        const size_t blockEnd = std::min(lines, blockFirst + static_cast<size_t>(decoded->lines.size()));
+        if (blockEnd <= line) {
+            break;
+        }
+        for (; line < blockEnd; ++line, y += lineHeight) {
+            painter.drawText(x, y, decoded->lines[static_cast<int>(line - blockFirst)]);
+        }
+        m_maxWidth = std::max(m_maxWidth, decoded->width);
+    }
+
+    // Not from within the paint; showing a scroll bar resizes the viewport
+    if (m_maxWidth != maxWidth) {
+        QMetaObject::invokeMethod(this, "updateScrollBars", Qt::QueuedConnection);
+    }
+}
+
+void TemplatePreview::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void TemplatePreview::changeEvent(QEvent *event)
+{
+    QAbstractScrollArea::changeEvent(event);
+    if (event->type() == QEvent::FontChange || event->type() == QEvent::StyleChange) {
+        // Cached widths were measured with the old font
+        m_blocks.clear();
+        m_maxWidth = 0;
+        updateScrollBars();
+    }
+}
+
+void TemplatePreview::scrollContentsBy(int dx, int dy)
+{
+    Q_UNUSED(dx)
+    Q_UNUSED(dy)
+    viewport()->update();
+}
+
+void TemplatePreview::indexMore()
+{
+    const size_t end = std::min(m_content.size(), m_indexed + IndexSlice);
+    while (m_indexed < end) {
+        const void *found = std::memchr(m_content.data() + m_indexed, '\n', end - m_indexed);
+        if (!found) {
+            m_indexed = end;
+            break;
+        }
+        m_indexed = static_cast<size_t>(static_cast<const char *>(found) - m_content.data()) + 1;
+        m_lineStarts.push_back(static_cast<uint32_t>(m_indexed));
+    }
+
+    if (isIndexed()) {
+        m_indexTimer->stop();
+    }
+    updateScrollBars();
+}
+
+void TemplatePreview::updateScrollBars()
+{
+    const int page = std::max(1, viewport()->height() / fontMetrics().lineSpacing());
+    size_t lines = knownLines();
+    if (!isIndexed() && m_indexed > 0) {
+        // Extrapolated from the part searched so far
+        lines = std::max(lines + 1, static_cast<size_t>(static_cast<double>(lines) * m_content.size() / m_indexed));
+    }
+    const size_t hidden = lines > static_cast<size_t>(page) ? lines - page : 0;
+    verticalScrollBar()->setPageStep(page);
+    verticalScrollBar()->setSingleStep(1);
+    verticalScrollBar()->setRange(0, static_cast<int>(std::min<size_t>(hidden, INT_MAX)));
+
+    horizontalScrollBar()->setPageStep(viewport()->width());
+    horizontalScrollBar()->setSingleStep(fontMetrics().averageCharWidth() * 4);
+    horizontalScrollBar()->setRange(0, std::max(0, m_maxWidth + 2 * Padding - viewport()->width()));
+}
+
+size_t TemplatePreview::knownLines() const
+{
+    if (m_content.empty()) {
+        return 0;
+    }
+    if (!isIndexed()) {
+        return m_lineStarts.size() - 1; // the last one's end is not found yet
+    }
+    // A final line break does not start another line
+    return m_lineStarts.back() == m_content.size() ? m_lineStarts.size() - 1 : m_lineStarts.size();
+}
+
+void TemplatePreview::indexTo(size_t line)
+{
+    while (!isIndexed() && m_lineStarts.size() <= line + 1) {
+        const void *found = std::memchr(m_content.data() + m_indexed, '\n', m_content.size() - m_indexed);
+        if (!found) {
+            m_indexed = m_content.size();
+            break;
+        }
+        m_indexed = static_cast<size_t>(static_cast<const char *>(found) - m_content.data()) + 1;
+        m_lineStarts.push_back(static_cast<uint32_t>(m_indexed));
+    }
+}
+
+const TemplatePreview::Block *TemplatePreview::block(size_t index)
+{
+    const QPair<quintptr, int> key(reinterpret_cast<quintptr>(m_content.data()), static_cast<int>(index));
+    if (const Block *cached = m_blocks.object(key)) {
+        return cached;
+    }
+
+    // A block is only decoded once all of its lines are known, so a
+    // cached one never needs to grow
+    const size_t first = index * BlockLines;
+    indexTo(first + BlockLines - 1);
+    const size_t end = std::min(knownLines(), first + BlockLines);
+
+    Block *decoded = new Block;
+    decoded->width = 0;
+    int cost = 1;
+    const QFontMetrics metrics = fontMetrics();
+    for (size_t line = first; line < end; ++line) {
+        const QString text = decodeLine(line);
+        decoded->width = std::max(decoded->width, metrics.size(Qt::TextSingleLine, text).width());
+        decoded->lines.append(text);
+        cost += text.size();
+    }
+    m_blocks.insert(key, decoded, cost);
+    return decoded;
+}
+
+QString TemplatePreview::decodeLine(size_t line) const
+{
+    const size_t begin = m_lineStarts[line];
+    size_t end = line + 1 < m_lineStarts.size() ? m_lineStarts[line + 1] - 1 : m_content.size();
+    if (end > begin && m_content[end - 1] == '\r') {
+        --end;
+    }
+
+    bool cut = false;
+    if (end - begin > MaxLineBytes) {
+        // Back off to the start of a UTF-8 sequence
+        end = begin + MaxLineBytes;
+        while (end > begin && (static_cast<unsigned char>(m_content[end]) & 0xC0) == 0x80) {
+            --end;
+        }
+        cut = true;
+    }
+
+    QString text = QString::fromUtf8(m_content.data() + begin, static_cast<int>(end - begin));
+    text.replace(QLatin1Char('\t'), QLatin1String("    "));
+    if (text.size() > MaxLineChars) {
+        text.truncate(text.at(MaxLineChars - 1).isHighSurrogate() ? MaxLineChars - 1 : MaxLineChars);
+        cut = true;
+    }
+    if (cut) {
+        text += QChar(0x2026);
+    }
+    return text;
+}
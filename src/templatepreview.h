@@ -0,0 +1,68 @@
+#ifndef TEMPLATEPREVIEW_H
+#define TEMPLATEPREVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QCache>
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+class QTimer;
+
+// Shows the selected template's content without converting all of it.
+// Line starts are found as far as the view needs and then in slices on
+// the event loop; only the blocks of lines in view are decoded to
+// QString. Decoded blocks stay in a small LRU cache keyed by the text
+// they came from, so returning to a recently previewed template is free.
+//
+// The content is viewed, not copied (see TemplateStore); reset() must be
+// called before the text it points into is freed.
+class TemplatePreview : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit TemplatePreview(QWidget *parent = nullptr);
+    ~TemplatePreview();
+
+    // Cheap: decoding waits for the paint that needs it
+    void setContent(std::string_view content);
+    // Forget the content and every cached block
+    void reset();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void changeEvent(QEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+
+private slots:
+    void indexMore();
+    void updateScrollBars();
+
+private:
+    struct Block {
+        QVector<QString> lines;
+        int width;
+    };
+
+    // Lines whose extent is known; all of them once indexing is complete
+    size_t knownLines() const;
+    bool isIndexed() const { return m_indexed >= m_content.size(); }
+    // Find line starts until line `line` is known or the text ends
+    void indexTo(size_t line);
+    const Block *block(size_t index);
+    QString decodeLine(size_t line) const;
+
+    std::string_view m_content;
+    std::vector<uint32_t> m_lineStarts;
+    size_t m_indexed; // bytes searched for line breaks
+    QTimer *m_indexTimer;
+    QCache<QPair<quintptr, int>, Block> m_blocks;
+    int m_maxWidth; // of the blocks painted so far
+};
+
+#endif // TEMPLATEPREVIEW_H
@@ -0,0 +1,331 @@
+#include "templatesearch.h"
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <algorithm>
+#include <numeric>
+
+namespace {
+// Bounds the memory held by cached result sets
+const size_t MaxHistoryDepth = 32;
+// Below this many candidates a single thread is faster than fanning out
+const size_t MinChunkSize = 8192;
+// Candidates scanned between cancellation checks
+const size_t CancelCheckInterval = 1024;
+// Position of a slot emptied by a reload
+const uint32_t RemovedSlot = 0xFFFFFFFFu;
+
+bool startsWith(const std::string &text, const std::string &prefix)
+{
+    return text.size() >= prefix.size() && text.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool isCancelled(const TemplateSearch::CancelCheck &cancelled)
+{
+    return cancelled && cancelled();
+}
+
+class ChunkTask : public QRunnable
+{
+public:
+    explicit ChunkTask(std::function<void()> work) : m_work(std::move(work)) {}
+    void run() override { m_work(); }
+
+private:
+    std::function<void()> m_work;
+};
+}
+
+TemplateSearch::TemplateSearch()
+    : m_templates(nullptr)
+    , m_mode(Mode::Substring)
+    , m_fuzzyResultLimit(500)
+    , m_inOrder(true)
+    , m_hasRemoved(false)
+{
+    // The calling thread scans a chunk too. Idle threads are kept, so a
+    // keystroke never waits for thread creation
+    m_chunkPool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+    m_chunkPool.setExpiryTimeout(-1);
+}
+
+TemplateSearch::~TemplateSearch() = default;
+
+void TemplateSearch::setTemplates(const TemplateStore &templates)
+{
+    m_templates = &templates;
+    m_history.clear();
+
+    m_index.clear();
+    for (uint32_t id = 0; id < templates.size(); ++id) {
+        m_index.addDocument(id, templates.searchKey(id));
+    }
+    m_fuzzyMatcher.setTemplates(templates);
+
+    std::vector<uint32_t> order(templates.size());
+    std::iota(order.begin(), order.end(), 0u);
+    setOrder(order, templates.size());
+}
+
+void TemplateSearch::applyDiff(TemplateStore &templates, const TemplateDiff &diff,
+                               const std::vector<Template> &incoming)
+{
+    m_templates = &templates;
+    m_history.clear();
+
+    for (uint32_t id : diff.removed) {
+        m_index.removeDocument(id, templates.searchKey(id));
+        templates.remove(id);
+        m_fuzzyMatcher.updateTemplate(id, templates.searchKey(id));
+    }
+
+    for (const auto &update : diff.updated) {
+        const uint32_t id = update.first;
+        m_index.removeDocument(id, templates.searchKey(id));
+        templates.replace(id, incoming[update.second]);
+        m_index.addDocument(id, templates.searchKey(id));
+        m_fuzzyMatcher.updateTemplate(id, templates.searchKey(id));
+    }
+
+    for (uint32_t index : diff.added) {
+        const uint32_t id = templates.append(incoming[index]);
+        m_index.addDocument(id, templates.searchKey(id));
+        m_fuzzyMatcher.updateTemplate(id, templates.searchKey(id));
+    }
+
+    setOrder(diff.order, templates.size());
+}
+
+void TemplateSearch::appendTemplates(TemplateStore &templates, const std::vector<Template> &incoming)
+{
+    m_templates = &templates;
+    m_history.clear();
+
+    for (const auto &tmpl : incoming) {
+        const uint32_t id = templates.append(tmpl);
+        m_index.addDocument(id, templates.searchKey(id));
+        m_fuzzyMatcher.updateTemplate(id, templates.searchKey(id));
+        m_position.push_back(static_cast<uint32_t>(m_order.size()));
+        m_order.push_back(id);
+    }
+}
+
+void TemplateSearch::setOrder(const std::vector<uint32_t> &order, size_t slotCount)
+{
+    m_order = order;
+    m_position.assign(slotCount, RemovedSlot);
+    for (size_t i = 0; i < order.size(); ++i) {
+        m_position[order[i]] = static_cast<uint32_t>(i);
+    }
+    m_inOrder = std::is_sorted(order.begin(), order.end());
+    m_hasRemoved = order.size() != slotCount;
+}
+
+void TemplateSearch::toDisplayOrder(std::vector<uint32_t> &ids) const
+{
+    if (m_hasRemoved) {
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [this](uint32_t id) {
+            return m_position[id] == RemovedSlot;
+        }), ids.end());
+    }
+    if (!m_inOrder) {
+        std::sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b) {
+            return m_position[a] < m_position[b];
+        });
+    }
+}
+
+void TemplateSearch::setMode(Mode mode)
+{
+    if (mode != m_mode) {
+        m_mode = mode;
+        m_history.clear();
+    }
+}
+
+void TemplateSearch::setFuzzyResultLimit(size_t limit)
+{
+    m_fuzzyResultLimit = limit;
+}
+
+void TemplateSearch::setBoosts(std::vector<int> boosts)
+{
+    m_boosts = std::move(boosts);
+}
+
+void TemplateSearch::setBoost(uint32_t id, int boost)
+{
+    if (id >= m_boosts.size()) {
+        m_boosts.resize(id + 1, 0);
+    }
+    m_boosts[id] = boost;
+}
+
+bool TemplateSearch::search(const std::string &foldedQuery, std::vector<uint32_t> &results,
+                            const CancelCheck &cancelled)
+{
+    if (!m_templates) {
+        results.clear();
+        return true;
+    }
+
+    // Drop cached results for queries this one no longer extends
+    while (!m_history.empty() && !startsWith(foldedQuery, m_history.back().query)) {
+        m_history.pop_back();
+    }
+
+    if (!m_history.empty() && m_history.back().query == foldedQuery) {
+        results = ranked(m_history.back());
+        return true;
+    }
+
+    // Any key matching the longer query also matches the shorter one, in
+    // both modes. Substring results of queries too short for the index
+    // are not narrowed yet, so the first query long enough for trigrams
+    // goes through the index instead.
+    CachedResult result;
+    result.query = foldedQuery;
+    bool completed = false;
+    if (m_mode == Mode::Substring) {
+        if (!m_history.empty() &&
+            (foldedQuery.size() < TrigramIndex::MinQuerySize || m_history.back().query.size() >= TrigramIndex::MinQuerySize)) {
+            completed = refine(m_history.back().matches, result, cancelled);
+        } else {
+            completed = searchAll(result, cancelled);
+        }
+    } else {
+        // The empty query matches everything; start from the prefilter instead
+        if (!m_history.empty() && !m_history.back().query.empty()) {
+            completed = refine(m_history.back().matches, result, cancelled);
+        } else {
+            completed = searchAll(result, cancelled);
+        }
+    }
+
+    if (!completed) {
+        return false;
+    }
+
+    if (m_history.size() >= MaxHistoryDepth) {
+        m_history.erase(m_history.begin());
+    }
+    m_history.push_back(std::move(result));
+    results = ranked(m_history.back());
+    return true;
+}
+
+bool TemplateSearch::searchAll(CachedResult &result, const CancelCheck &cancelled)
+{
+    std::vector<uint32_t> candidates;
+
+    if (m_mode == Mode::Fuzzy) {
+        m_fuzzyMatcher.setQuery(result.query);
+        m_fuzzyMatcher.prefilter(candidates);
+    } else if (!m_index.candidates(result.query, candidates)) {
+        // Query too short for trigrams; fall back to scanning everything
+        return refine(m_order, result, cancelled);
+    }
+
+    // Both come back in slot order, which may include emptied slots
+    toDisplayOrder(candidates);
+    return refine(candidates, result, cancelled);
+}
+
+bool TemplateSearch::refine(const std::vector<uint32_t> &candidates, CachedResult &result, const CancelCheck &cancelled)
+{
+    const TemplateStore &templates = *m_templates;
+    const bool fuzzy = m_mode == Mode::Fuzzy;
+    if (fuzzy) {
+        m_fuzzyMatcher.setQuery(result.query);
+    }
+
+    const size_t threads = static_cast<size_t>(m_chunkPool.maxThreadCount()) + 1;
+    const size_t chunkCount = std::max<size_t>(1, std::min(threads, candidates.size() / MinChunkSize));
+    std::vector<CachedResult> parts(chunkCount);
+
+    // Each chunk keeps its matches in candidate order, so concatenating
+    // the parts preserves the order of the whole set
+    auto scanChunk = [&](size_t chunk) {
+        const size_t begin = candidates.size() * chunk / chunkCount;
+        const size_t end = candidates.size() * (chunk + 1) / chunkCount;
+        CachedResult &part = parts[chunk];
+        for (size_t i = begin; i < end; ++i) {
+            if ((i - begin) % CancelCheckInterval == 0 && isCancelled(cancelled)) {
+                return;
+            }
+
+            const uint32_t id = candidates[i];
+            if (fuzzy) {
+                int score = 0;
+                if (m_fuzzyMatcher.score(templates.searchKey(id), score)) {
+                    part.matches.push_back(id);
+                    part.scores.push_back(score);
+                }
+            } else if (templates.searchKey(id).find(result.query) != std::string_view::npos) {
+                part.matches.push_back(id);
+            }
+        }
+    };
+
+    // Counted with a semaphore rather than QThreadPool::waitForDone(),
+    // which also stops the pool's threads
+    QSemaphore scanned;
+    for (size_t chunk = 1; chunk < chunkCount; ++chunk) {
+        m_chunkPool.start(new ChunkTask([&scanChunk, &scanned, chunk]() {
+            scanChunk(chunk);
+            scanned.release();
+        }));
+    }
+    scanChunk(0);
+    scanned.acquire(static_cast<int>(chunkCount - 1));
+
+    if (isCancelled(cancelled)) {
+        return false;
+    }
+
+    size_t total = 0;
+    for (const auto &part : parts) {
+        total += part.matches.size();
+    }
+    result.matches.reserve(total);
+    result.scores.reserve(fuzzy ? total : 0);
+    for (const auto &part : parts) {
+        result.matches.insert(result.matches.end(), part.matches.begin(), part.matches.end());
+        result.scores.insert(result.scores.end(), part.scores.begin(), part.scores.end());
+    }
+    return true;
+}
+
+std::vector<uint32_t> TemplateSearch::ranked(const CachedResult &result) const
+{
+    if (m_mode == Mode::Substring || result.query.empty()) {
+        if (m_boosts.empty()) {
+            return result.matches;
+        }
+
+        // Boosted templates first; only those few need sorting, and
+        // stable passes keep file order among equal boosts
+        std::vector<uint32_t> order = result.matches;
+        auto boosted = std::stable_partition(order.begin(), order.end(), [this](uint32_t id) {
+            return boostOf(id) > 0;
+        });
+        std::stable_sort(order.begin(), boosted, [this](uint32_t a, uint32_t b) {
+            return boostOf(a) > boostOf(b);
+        });
+        return order;
+    }
+
+    std::vector<FuzzyMatcher::Match> scored;
+    scored.reserve(result.matches.size());
+    for (size_t i = 0; i < result.matches.size(); ++i) {
+        scored.push_back({result.matches[i], result.scores[i] + boostOf(result.matches[i])});
+    }
+    FuzzyMatcher::rank(scored, m_fuzzyResultLimit);
+
+    std::vector<uint32_t> order;
+    order.reserve(scored.size());
+    for (const auto &match : scored) {
+        order.push_back(match.id);
+    }
+    return order;
+}
@@ -0,0 +1,98 @@
+#ifndef TEMPLATESEARCH_H
+#define TEMPLATESEARCH_H
+
+#include <QThreadPool>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "templatestore.h"
+#include "trigramindex.h"
+#include "fuzzymatcher.h"
+#include "templatediff.h"
+
+// Search over the folded search keys of a template list.
+//
+// Substring mode keeps list order; the trigram index narrows the
+// candidates and each one is then verified. Fuzzy mode ranks subsequence
+// matches by score and returns at most the configured number of results.
+//
+// Results of previous queries are kept on a stack: a query that extends
+// the last one only re-checks the last result set, and deleting
+// characters pops back to a cached result.
+//
+// Optional per-template boosts (frecency, see UsageLog) lift templates
+// in both modes: in substring mode boosted templates come first, highest
+// boost first; in fuzzy mode the boost is added to the match score.
+//
+// After a reload, applyDiff() updates the index in place; results then
+// follow the file order of the live slots.
+//
+// Large candidate sets are verified in parallel chunks, on threads the
+// search keeps for its lifetime rather than starts per query. A search
+// is not thread-safe itself; callers run one at a time (see SearchWorker).
+class TemplateSearch {
+public:
+    // Polled while scanning; returning true abandons the search
+    using CancelCheck = std::function<bool()>;
+
+    enum class Mode {
+        Substring,
+        Fuzzy
+    };
+
+    TemplateSearch();
+    ~TemplateSearch();
+
+    // The store must outlive the search or be replaced by another call
+    void setTemplates(const TemplateStore &templates);
+
+    // Apply a diff to the store given to setTemplates(), copying changed
+    // templates from incoming, and update the index to match
+    void applyDiff(TemplateStore &templates, const TemplateDiff &diff, const std::vector<Template> &incoming);
+
+    // Append incoming to the store and index it
+    void appendTemplates(TemplateStore &templates, const std::vector<Template> &incoming);
+
+    void setMode(Mode mode);
+    Mode mode() const { return m_mode; }
+    void setFuzzyResultLimit(size_t limit);
+
+    // Boost per template index; missing entries count as 0
+    void setBoosts(std::vector<int> boosts);
+    void setBoost(uint32_t id, int boost);
+
+    // Indices of the templates matching the already-folded query.
+    // Returns false (leaving results untouched) if cancelled.
+    bool search(const std::string &foldedQuery, std::vector<uint32_t> &results,
+                const CancelCheck &cancelled = CancelCheck());
+
+private:
+    struct CachedResult {
+        std::string query;
+        std::vector<uint32_t> matches; // template indices in file order
+        std::vector<int> scores;       // fuzzy mode only, parallel to matches
+    };
+
+    bool searchAll(CachedResult &result, const CancelCheck &cancelled);
+    bool refine(const std::vector<uint32_t> &candidates, CachedResult &result, const CancelCheck &cancelled);
+    std::vector<uint32_t> ranked(const CachedResult &result) const;
+    void setOrder(const std::vector<uint32_t> &order, size_t slotCount);
+    void toDisplayOrder(std::vector<uint32_t> &ids) const;
+    int boostOf(uint32_t id) const { return id < m_boosts.size() ? m_boosts[id] : 0; }
+
+    const TemplateStore *m_templates;
+    QThreadPool m_chunkPool; // scans all chunks but the caller's
+    TrigramIndex m_index;
+    FuzzyMatcher m_fuzzyMatcher;
+    Mode m_mode;
+    size_t m_fuzzyResultLimit;
+    std::vector<CachedResult> m_history;
+    std::vector<int> m_boosts;
+    std::vector<uint32_t> m_order;    // live slot ids in file order
+    std::vector<uint32_t> m_position; // index in m_order per slot, RemovedSlot if empty
+    bool m_inOrder;                   // m_order is ascending
+    bool m_hasRemoved;
+};
+
+#endif // TEMPLATESEARCH_H
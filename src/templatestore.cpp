@@ -0,0 +1,174 @@
+#include "templatestore.h"
+#include "hashutil.h"
+#include <cstring>
+
+namespace {
+const size_t BlockSize = 1 << 20;
+// Larger strings get a block of their own rather than wasting the rest
+// of the current one
+const size_t MaxSharedSize = BlockSize / 4;
+}
+
+TemplateStore::TemplateStore()
+    : m_arenaSize(0)
+    , m_garbageSize(0)
+{
+}
+
+TemplateStore::~TemplateStore() = default;
+
+void TemplateStore::clear()
+{
+    m_blocks.clear();
+    m_arenaSize = 0;
+    m_garbageSize = 0;
+    m_searchKeys.clear();
+    m_shortcuts.clear();
+    m_names.clear();
+    m_categories.clear();
+    m_contents.clear();
+    m_segmentRanges.clear();
+    m_segments.clear();
+    m_internedContents.clear();
+    m_internedCategories.clear();
+}
+
+void TemplateStore::reserve(size_t count)
+{
+    m_searchKeys.reserve(count);
+    m_shortcuts.reserve(count);
+    m_names.reserve(count);
+    m_categories.reserve(count);
+    m_contents.reserve(count);
+    m_segmentRanges.reserve(count);
+    m_internedContents.reserve(count);
+}
+
+void TemplateStore::assign(std::vector<Template> &&templates)
+{
+    clear();
+    reserve(templates.size());
+
+    // Freeing each template once copied keeps the peak near one copy
+    for (Template &tmpl : templates) {
+        append(tmpl);
+        tmpl = Template();
+    }
+    std::vector<Template>().swap(templates);
+}
+
+uint32_t TemplateStore::append(const Template &tmpl)
+{
+    return append(tmpl.name, tmpl.content, tmpl.category, tmpl.searchKey, tmpl.shortcut, tmpl.segments.data(),
+                  tmpl.segments.size());
+}
+
+uint32_t TemplateStore::append(std::string_view name, std::string_view content, std::string_view category,
+                               std::string_view searchKey, int shortcut, const TemplateSegment *segments,
+                               size_t segmentCount)
+{
+    const uint32_t id = static_cast<uint32_t>(m_searchKeys.size());
+    m_searchKeys.emplace_back();
+    m_shortcuts.push_back(0);
+    m_names.emplace_back();
+    m_categories.emplace_back();
+    m_contents.emplace_back();
+    m_segmentRanges.push_back({0, 0});
+    set(id, name, content, category, searchKey, shortcut, segments, segmentCount);
+    return id;
+}
+
+void TemplateStore::replace(uint32_t id, const Template &tmpl)
+{
+    release(id);
+    set(id, tmpl);
+}
+
+void TemplateStore::remove(uint32_t id)
+{
+    release(id);
+    set(id, Template());
+}
+
+Template TemplateStore::pasteTemplate(uint32_t id) const
+{
+    Template tmpl;
+    tmpl.content = std::string(m_contents[id]);
+    const SegmentRange &range = m_segmentRanges[id];
+    tmpl.segments.assign(m_segments.begin() + range.first, m_segments.begin() + range.first + range.count);
+    return tmpl;
+}
+
+void TemplateStore::set(uint32_t id, const Template &tmpl)
+{
+    set(id, tmpl.name, tmpl.content, tmpl.category, tmpl.searchKey, tmpl.shortcut, tmpl.segments.data(),
+        tmpl.segments.size());
+}
+
+void TemplateStore::set(uint32_t id, std::string_view name, std::string_view content, std::string_view category,
+                        std::string_view searchKey, int shortcut, const TemplateSegment *segments,
+                        size_t segmentCount)
+{
+    m_searchKeys[id] = store(searchKey);
+    m_shortcuts[id] = shortcut;
+    m_names[id] = store(name);
+    m_categories[id] = intern(category, m_internedCategories);
+    m_contents[id] = intern(content, m_internedContents);
+
+    SegmentRange range = {static_cast<uint32_t>(m_segments.size()), static_cast<uint32_t>(segmentCount)};
+    m_segments.insert(m_segments.end(), segments, segments + segmentCount);
+    m_segmentRanges[id] = range;
+}
+
+void TemplateStore::release(uint32_t id)
+{
+    // Contents may be shared with other slots, hence only an upper bound
+    m_garbageSize += m_searchKeys[id].size() + m_names[id].size() + m_contents[id].size();
+}
+
+std::string_view TemplateStore::store(std::string_view text)
+{
+    if (text.empty()) {
+        return std::string_view();
+    }
+
+    if (text.size() > MaxSharedSize) {
+        Block block = {std::unique_ptr<char[]>(new char[text.size()]), text.size(), text.size()};
+        std::memcpy(block.data.get(), text.data(), text.size());
+        const char *data = block.data.get();
+        // Keep the partly filled block last, so later strings still fill it
+        m_blocks.insert(m_blocks.empty() ? m_blocks.end() : m_blocks.end() - 1, std::move(block));
+        m_arenaSize += text.size();
+        return std::string_view(data, text.size());
+    }
+
+    if (m_blocks.empty() || m_blocks.back().size - m_blocks.back().used < text.size()) {
+        m_blocks.push_back({std::unique_ptr<char[]>(new char[BlockSize]), BlockSize, 0});
+        m_arenaSize += BlockSize;
+    }
+    Block &block = m_blocks.back();
+    char *data = block.data.get() + block.used;
+    std::memcpy(data, text.data(), text.size());
+    block.used += text.size();
+    return std::string_view(data, text.size());
+}
+
+std::string_view TemplateStore::intern(std::string_view text, Interned &interned)
+{
+    if (text.empty()) {
+        return std::string_view();
+    }
+
+    const uint64_t hash = fnv1a64(text);
+    auto it = interned.find(hash);
+    if (it != interned.end() && it->second == text) {
+        return it->second;
+    }
+
+    // On a hash collision the first text keeps the entry
+    const std::string_view stored = store(text);
+    if (it == interned.end()) {
+        interned.emplace(hash, stored);
+    }
+    return stored;
+}
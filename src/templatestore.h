@@ -0,0 +1,99 @@
+#ifndef TEMPLATESTORE_H
+#define TEMPLATESTORE_H
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "templatemanager.h"
+
+// The loaded templates as slots (see TemplateDiff), kept compact: their
+// text lives in a few large arena blocks instead of one allocation per
+// string, each field is a column of its own so a search only walks the
+// search keys, and identical contents and categories are stored once.
+//
+// Blocks never move, so views stay valid while templates are appended;
+// they are invalidated by assign() and clear(). Replaced and removed
+// templates leave their text in the arena until the store is rebuilt.
+class TemplateStore {
+public:
+    TemplateStore();
+    ~TemplateStore();
+    TemplateStore(const TemplateStore &) = delete;
+    TemplateStore &operator=(const TemplateStore &) = delete;
+
+    void clear();
+    void reserve(size_t count);
+    // Replace every slot; templates are released as they are copied in
+    void assign(std::vector<Template> &&templates);
+    // Returns the new slot id
+    uint32_t append(const Template &tmpl);
+    // The same from fields read elsewhere, such as a mapped TemplateCache,
+    // with segments already compiled for content
+    uint32_t append(std::string_view name, std::string_view content, std::string_view category,
+                    std::string_view searchKey, int shortcut, const TemplateSegment *segments, size_t segmentCount);
+    void replace(uint32_t id, const Template &tmpl);
+    // Leaves an empty slot behind
+    void remove(uint32_t id);
+
+    size_t size() const { return m_searchKeys.size(); }
+    bool isEmpty() const { return m_searchKeys.empty(); }
+    bool isRemoved(uint32_t id) const { return m_searchKeys[id].empty(); }
+
+    std::string_view name(uint32_t id) const { return m_names[id]; }
+    std::string_view category(uint32_t id) const { return m_categories[id]; }
+    std::string_view content(uint32_t id) const { return m_contents[id]; }
+    std::string_view searchKey(uint32_t id) const { return m_searchKeys[id]; }
+    int shortcut(uint32_t id) const { return m_shortcuts[id]; }
+
+    // Content and placeholders only, owned so a paste can expand them
+    // after a reload changed the slot; see Placeholders
+    Template pasteTemplate(uint32_t id) const;
+
+    // Bytes allocated for text, and an upper bound of the part no live
+    // slot refers to any more
+    size_t arenaSize() const { return m_arenaSize; }
+    size_t garbageSize() const { return m_garbageSize; }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+        size_t used;
+    };
+
+    struct SegmentRange {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    using Interned = std::unordered_map<uint64_t, std::string_view>;
+
+    void set(uint32_t id, std::string_view name, std::string_view content, std::string_view category,
+             std::string_view searchKey, int shortcut, const TemplateSegment *segments, size_t segmentCount);
+    void set(uint32_t id, const Template &tmpl);
+    std::string_view store(std::string_view text);
+    std::string_view intern(std::string_view text, Interned &interned);
+    void release(uint32_t id);
+
+    std::vector<Block> m_blocks;
+    size_t m_arenaSize;
+    size_t m_garbageSize;
+
+    // Read on every keystroke or painted row
+    std::vector<std::string_view> m_searchKeys;
+    std::vector<int> m_shortcuts;
+    std::vector<std::string_view> m_names;
+    std::vector<std::string_view> m_categories;
+    // Read when pasting
+    std::vector<std::string_view> m_contents;
+    std::vector<SegmentRange> m_segmentRanges;
+    std::vector<TemplateSegment> m_segments;
+
+    // Content hash to the stored text; duplicates share it
+    Interned m_internedContents;
+    Interned m_internedCategories;
+};
+
+#endif // TEMPLATESTORE_H
@@ -0,0 +1,185 @@
+#include "trace.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// A resident daemon keeps recording; stop growing past this
+const size_t MaxEvents = 1 << 20;
+
+struct Event {
+    const char *name;
+    int64_t begin;
+    int64_t end; // -1 for instant events
+    int thread;
+    std::string detail;
+};
+
+std::mutex eventsMutex;
+std::vector<Event> events;
+std::string tracePath;
+Clock::time_point origin;
+std::atomic<int> nextThread(0);
+
+int threadId()
+{
+    thread_local const int id = ++nextThread;
+    return id;
+}
+
+void add(Event event)
+{
+    std::lock_guard<std::mutex> lock(eventsMutex);
+    if (events.size() < MaxEvents) {
+        events.push_back(std::move(event));
+    }
+}
+
+void writeString(std::ostream &out, const char *text)
+{
+    out << '"';
+    for (const char *c = text; *c; ++c) {
+        const unsigned char ch = static_cast<unsigned char>(*c);
+        if (ch == '"' || ch == '\\') {
+            out << '\\' << *c;
+        } else if (ch < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+            out << escaped;
+        } else {
+            out << *c;
+        }
+    }
+    out << '"';
+}
+
+// Microseconds with the nanoseconds as decimals
+void writeMicroseconds(std::ostream &out, int64_t nanoseconds)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%lld.%03lld", static_cast<long long>(nanoseconds / 1000),
+                  static_cast<long long>(nanoseconds % 1000));
+    out << text;
+}
+
+} // namespace
+
+std::atomic<bool> Trace::s_enabled(false);
+
+void Trace::enableFromArguments(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--trace") == 0) {
+            enable(std::string());
+            return;
+        }
+        if (std::strncmp(argv[i], "--trace=", 8) == 0) {
+            enable(argv[i] + 8);
+            return;
+        }
+    }
+
+    const char *path = std::getenv("CLIP_TEMPLATE_TRACE");
+    if (path && *path && std::strcmp(path, "0") != 0) {
+        enable(std::strcmp(path, "1") == 0 ? std::string() : std::string(path));
+    }
+}
+
+void Trace::enable(const std::string &path)
+{
+    if (isEnabled()) {
+        return;
+    }
+
+    tracePath = path;
+    if (tracePath.empty()) {
+        const char *tmp = std::getenv("TMPDIR");
+        tracePath = std::string(tmp && *tmp ? tmp : "/tmp") + "/clip-template-trace-" +
+                    std::to_string(getpid()) + ".json";
+    }
+    origin = Clock::now();
+    threadId(); // the enabling (main) thread is thread 1
+    events.reserve(4096);
+    s_enabled.store(true, std::memory_order_relaxed);
+    std::cerr << "[clip-template] Tracing to " << tracePath << std::endl;
+}
+
+int64_t Trace::now()
+{
+    if (!isEnabled()) {
+        return 0; // skip the clock read
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - origin).count();
+}
+
+void Trace::span(const char *name, int64_t begin, int64_t end, const std::string &detail)
+{
+    if (isEnabled()) {
+        add({name, begin, end, threadId(), detail});
+    }
+}
+
+void Trace::instant(const char *name)
+{
+    if (isEnabled()) {
+        add({name, now(), -1, threadId(), std::string()});
+    }
+}
+
+bool Trace::write()
+{
+    if (!isEnabled()) {
+        return false;
+    }
+
+    // Written aside and renamed so a viewer never sees half a file
+    const std::string partial = tracePath + ".part";
+    std::ofstream out(partial, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Error writing trace: cannot open " << partial << std::endl;
+        return false;
+    }
+
+    const long long pid = getpid();
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+        << ",\"args\":{\"name\":\"clip-template\"}}";
+    {
+        std::lock_guard<std::mutex> lock(eventsMutex);
+        for (const Event &event : events) {
+            out << ",\n{\"name\":";
+            writeString(out, event.name);
+            out << ",\"cat\":\"clip-template\",\"pid\":" << pid << ",\"tid\":" << event.thread << ",\"ts\":";
+            writeMicroseconds(out, event.begin);
+            if (event.end < 0) {
+                out << ",\"ph\":\"i\",\"s\":\"t\"";
+            } else {
+                out << ",\"ph\":\"X\",\"dur\":";
+                writeMicroseconds(out, event.end - event.begin);
+            }
+            if (!event.detail.empty()) {
+                out << ",\"args\":{\"detail\":";
+                writeString(out, event.detail.c_str());
+                out << '}';
+            }
+            out << '}';
+        }
+    }
+    out << "\n]}\n";
+    out.close();
+
+    if (!out || std::rename(partial.c_str(), tracePath.c_str()) != 0) {
+        std::cerr << "Error writing trace: " << tracePath << std::endl;
+        return false;
+    }
+    return true;
+}
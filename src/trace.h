@@ -0,0 +1,67 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Phase tracing in the Chrome trace_event format; open the file in
+// chrome://tracing or ui.perfetto.dev. Enabled by --trace[=FILE] or
+// CLIP_TEMPLATE_TRACE=FILE (1 picks a file in the temp directory).
+// While disabled a span costs one relaxed atomic load.
+class Trace {
+public:
+    // Checks the command line and environment; call first thing in main
+    static void enableFromArguments(int argc, char *argv[]);
+    // An empty path picks the default file
+    static void enable(const std::string &path);
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    // Nanoseconds since tracing was enabled
+    static int64_t now();
+
+    // name must outlive the trace (a string literal); it is kept as is
+    static void span(const char *name, int64_t begin, int64_t end, const std::string &detail = std::string());
+    static void instant(const char *name);
+
+    // Writes everything recorded so far, replacing the file
+    static bool write();
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+// Records a span from construction to destruction
+class TraceScope {
+public:
+    explicit TraceScope(const char *name)
+        : m_name(Trace::isEnabled() ? name : nullptr)
+        , m_begin(m_name ? Trace::now() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (m_name) {
+            Trace::span(m_name, m_begin, Trace::now(), m_detail);
+        }
+    }
+
+    // Shown with the span, e.g. the file it read
+    void setDetail(const std::string &detail)
+    {
+        if (m_name) {
+            m_detail = detail;
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *m_name;
+    int64_t m_begin;
+    std::string m_detail;
+};
+
+#endif // TRACE_H
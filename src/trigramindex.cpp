@@ -0,0 +1,131 @@
+#include "trigramindex.h"
+#include <algorithm>
+
+namespace {
+
+const uint32_t InvalidTrigram = 0xFFFFFFFFu;
+
+uint32_t packTrigram(std::string_view text, size_t pos)
+{
+    const unsigned char a = static_cast<unsigned char>(text[pos]);
+    const unsigned char b = static_cast<unsigned char>(text[pos + 1]);
+    const unsigned char c = static_cast<unsigned char>(text[pos + 2]);
+    // '\0' separates fields in search keys; queries never span them
+    if (a == 0 || b == 0 || c == 0) {
+        return InvalidTrigram;
+    }
+    return (static_cast<uint32_t>(a) << 16) | (static_cast<uint32_t>(b) << 8) | c;
+}
+
+} // namespace
+
+TrigramIndex::TrigramIndex() = default;
+TrigramIndex::~TrigramIndex() = default;
+
+void TrigramIndex::clear()
+{
+    m_postings.clear();
+}
+
+void TrigramIndex::reserve(size_t trigramCount)
+{
+    m_postings.reserve(trigramCount);
+}
+
+void TrigramIndex::addDocument(uint32_t id, std::string_view text)
+{
+    // When ids arrive in increasing order, a repeated trigram within the
+    // same document is simply one whose list already ends with this id
+    for (size_t i = 0; i + 2 < text.size(); ++i) {
+        const uint32_t trigram = packTrigram(text, i);
+        if (trigram == InvalidTrigram) {
+            continue;
+        }
+        std::vector<uint32_t> &list = m_postings[trigram];
+        if (list.empty() || list.back() < id) {
+            list.push_back(id);
+        } else if (list.back() != id) {
+            auto it = std::lower_bound(list.begin(), list.end(), id);
+            if (*it != id) {
+                list.insert(it, id);
+            }
+        }
+    }
+}
+
+void TrigramIndex::removeDocument(uint32_t id, std::string_view text)
+{
+    std::vector<uint32_t> trigrams;
+    collectTrigrams(text, trigrams);
+    for (uint32_t trigram : trigrams) {
+        auto posting = m_postings.find(trigram);
+        if (posting == m_postings.end()) {
+            continue;
+        }
+        std::vector<uint32_t> &list = posting->second;
+        auto it = std::lower_bound(list.begin(), list.end(), id);
+        if (it != list.end() && *it == id) {
+            list.erase(it);
+        }
+        if (list.empty()) {
+            m_postings.erase(posting);
+        }
+    }
+}
+
+bool TrigramIndex::candidates(const std::string &query, std::vector<uint32_t> &candidates) const
+{
+    candidates.clear();
+    if (query.size() < MinQuerySize) {
+        return false;
+    }
+
+    std::vector<uint32_t> trigrams;
+    collectTrigrams(query, trigrams);
+
+    std::vector<const std::vector<uint32_t> *> lists;
+    lists.reserve(trigrams.size());
+    for (uint32_t trigram : trigrams) {
+        auto it = m_postings.find(trigram);
+        if (it == m_postings.end()) {
+            return true; // some trigram occurs nowhere: no candidates
+        }
+        lists.push_back(&it->second);
+    }
+
+    // Intersect shortest lists first so the working set shrinks fastest
+    std::sort(lists.begin(), lists.end(), [](const std::vector<uint32_t> *a, const std::vector<uint32_t> *b) {
+        return a->size() < b->size();
+    });
+
+    candidates = *lists.front();
+    std::vector<uint32_t> narrowed;
+    for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i) {
+        narrowed.clear();
+        std::set_intersection(candidates.begin(), candidates.end(),
+                              lists[i]->begin(), lists[i]->end(),
+                              std::back_inserter(narrowed));
+        candidates.swap(narrowed);
+    }
+
+    return true;
+}
+
+void TrigramIndex::collectTrigrams(std::string_view text, std::vector<uint32_t> &trigrams)
+{
+    trigrams.clear();
+    if (text.size() < 3) {
+        return;
+    }
+
+    trigrams.reserve(text.size() - 2);
+    for (size_t i = 0; i + 2 < text.size(); ++i) {
+        const uint32_t trigram = packTrigram(text, i);
+        if (trigram != InvalidTrigram) {
+            trigrams.push_back(trigram);
+        }
+    }
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
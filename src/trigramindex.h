@@ -0,0 +1,43 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Inverted index from byte trigrams to the sorted ids of the documents
+// containing them. Used to narrow substring-search candidates; callers
+// still verify each candidate against the full text.
+class TrigramIndex {
+public:
+    static const size_t MinQuerySize = 3;
+
+    TrigramIndex();
+    ~TrigramIndex();
+
+    void clear();
+    void reserve(size_t trigramCount);
+
+    // Adding ids in increasing order is the fast path; any other id is
+    // inserted into the sorted lists
+    void addDocument(uint32_t id, std::string_view text);
+
+    // text must be what the document was added with
+    void removeDocument(uint32_t id, std::string_view text);
+
+    // Returns false if the query is shorter than a trigram and the index
+    // cannot narrow the search. Otherwise fills candidates (sorted) with
+    // every document that contains all of the query's trigrams.
+    bool candidates(const std::string &query, std::vector<uint32_t> &candidates) const;
+
+    size_t trigramCount() const { return m_postings.size(); }
+
+private:
+    static void collectTrigrams(std::string_view text, std::vector<uint32_t> &trigrams);
+
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_postings;
+};
+
+#endif // TRIGRAMINDEX_H
@@ -0,0 +1,200 @@
+#include "usagelog.h"
+#include "hashutil.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const char LogMagic[8] = {'C', 'L', 'P', 'T', 'U', 'S', 'E', '1'};
+
+struct UsageRecord {
+    uint64_t key;
+    int64_t time; // seconds since the epoch
+};
+
+const double HalfLife = 14 * 24 * 3600.0;   // seconds
+const double MinWeight = 1.0 / 64;          // older uses are dropped when compacting
+const size_t MaxUsesPerTemplate = 32;
+const double BoostScale = 8.0;
+const int MaxBoost = 48;
+// Compact once the file holds this many more records than are retained
+const size_t CompactSlack = 1024;
+
+double weight(int64_t now, int64_t time)
+{
+    return std::exp2(-std::max<int64_t>(0, now - time) / HalfLife);
+}
+
+} // namespace
+
+UsageLog::UsageLog()
+    : m_retained(0)
+    , m_fileRecords(0)
+    , m_now(QDateTime::currentSecsSinceEpoch())
+{
+    QString dataDir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
+    dataDir += "/clip-template";
+    QDir().mkpath(dataDir);
+    m_path = (dataDir + "/usage.log").toStdString();
+}
+
+UsageLog::~UsageLog() = default;
+
+bool UsageLog::load()
+{
+    m_uses.clear();
+    m_retained = 0;
+    m_fileRecords = 0;
+    m_now = QDateTime::currentSecsSinceEpoch();
+
+    // Whether the file must be rewritten before anything is appended
+    bool torn = false;
+    QFile file(QString::fromStdString(m_path));
+    if (file.open(QIODevice::ReadOnly) && file.size() < static_cast<qint64>(sizeof(LogMagic))) {
+        torn = file.size() > 0; // a crash while writing the magic
+    } else if (file.isOpen()) {
+        const uchar *data = file.map(0, file.size());
+        if (data && std::memcmp(data, LogMagic, sizeof(LogMagic)) == 0) {
+            // A torn last record (from a crash mid-write) is ignored
+            const size_t count = (static_cast<size_t>(file.size()) - sizeof(LogMagic)) / sizeof(UsageRecord);
+            torn = (static_cast<size_t>(file.size()) - sizeof(LogMagic)) % sizeof(UsageRecord) != 0;
+            const uchar *records = data + sizeof(LogMagic);
+            for (size_t i = 0; i < count; ++i) {
+                UsageRecord record;
+                std::memcpy(&record, records + i * sizeof(UsageRecord), sizeof(record));
+                addUse(record.key, record.time);
+            }
+            m_fileRecords = count;
+        } else {
+            qDebug() << "[clip-template] Ignoring unreadable usage log.";
+            torn = true;
+        }
+        if (data) {
+            file.unmap(const_cast<uchar *>(data));
+        }
+    }
+    file.close();
+
+    // Records appended behind a torn one would be read misaligned, as
+    // garbage, so the log is rewritten without it first. A missing or
+    // empty log is only opened; openForAppend() writes the magic.
+    if (torn || m_fileRecords > 2 * m_retained + CompactSlack) {
+        return compact();
+    }
+    return openForAppend();
+}
+
+void UsageLog::record(uint64_t key)
+{
+    const UsageRecord record = {key, QDateTime::currentSecsSinceEpoch()};
+    m_now = record.time;
+    addUse(record.key, record.time);
+
+    if (!m_file.isOpen() && !openForAppend()) {
+        return;
+    }
+    const bool written = m_file.write(reinterpret_cast<const char *>(&record), sizeof(record)) == sizeof(record) &&
+                         m_file.flush();
+    ++m_fileRecords;
+
+    // A short write leaves a torn record, which compacting drops
+    if (!written || m_fileRecords > 2 * m_retained + CompactSlack) {
+        compact();
+    }
+}
+
+int UsageLog::boost(uint64_t key) const
+{
+    auto it = m_uses.find(key);
+    if (it == m_uses.end()) {
+        return 0;
+    }
+
+    double frecency = 0;
+    for (int64_t time : it->second) {
+        frecency += weight(m_now, time);
+    }
+    return std::min(MaxBoost, static_cast<int>(std::lround(BoostScale * std::log2(1.0 + frecency))));
+}
+
+uint64_t UsageLog::keyOf(std::string_view name, std::string_view category)
+{
+    const char separator = '\0';
+    return fnv1a64(category, fnv1a64(&separator, 1, fnv1a64(name)));
+}
+
+bool UsageLog::compact()
+{
+    m_file.close();
+
+    // Keep only the uses that still carry weight, oldest first
+    std::vector<UsageRecord> records;
+    records.reserve(m_retained);
+    for (auto it = m_uses.begin(); it != m_uses.end();) {
+        std::vector<int64_t> &times = it->second;
+        times.erase(std::remove_if(times.begin(), times.end(), [this](int64_t time) {
+            return weight(m_now, time) < MinWeight;
+        }), times.end());
+        if (times.empty()) {
+            it = m_uses.erase(it);
+            continue;
+        }
+        for (int64_t time : times) {
+            records.push_back({it->first, time});
+        }
+        ++it;
+    }
+    std::sort(records.begin(), records.end(), [](const UsageRecord &a, const UsageRecord &b) {
+        return a.time < b.time;
+    });
+
+    QSaveFile file(QString::fromStdString(m_path));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(LogMagic, sizeof(LogMagic));
+    if (!records.empty()) {
+        file.write(reinterpret_cast<const char *>(records.data()),
+                   static_cast<qint64>(records.size() * sizeof(UsageRecord)));
+    }
+    if (!file.commit()) {
+        return false;
+    }
+
+    m_retained = records.size();
+    m_fileRecords = records.size();
+    return openForAppend();
+}
+
+bool UsageLog::openForAppend()
+{
+    m_file.close();
+    m_file.setFileName(QString::fromStdString(m_path));
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qDebug() << "[clip-template] Cannot open usage log:" << m_file.errorString();
+        return false;
+    }
+    if (m_file.size() == 0) {
+        m_file.write(LogMagic, sizeof(LogMagic));
+        m_file.flush();
+    }
+    return true;
+}
+
+void UsageLog::addUse(uint64_t key, int64_t time)
+{
+    std::vector<int64_t> &times = m_uses[key];
+    times.push_back(time);
+    ++m_retained;
+    if (times.size() > MaxUsesPerTemplate) {
+        times.erase(times.begin());
+        --m_retained;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef USAGELOG_H
+#define USAGELOG_H
+
+#include <QFile>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Records every paste in ~/.local/share/clip-template/usage.log and
+// derives a frecency boost from it: each use counts for less as it ages
+// (halving every two weeks), so templates used often and recently rank
+// higher.
+//
+// The log is append-only, one fixed-size record (template key, time) per
+// paste, written through a file kept open so recording costs a single
+// small write. Once obsolete records make up most of it, the log is
+// rewritten with only the uses that still count.
+class UsageLog {
+public:
+    UsageLog();
+    ~UsageLog();
+
+    bool load();
+    void record(uint64_t key);
+
+    bool isEmpty() const { return m_uses.empty(); }
+
+    // Ranking bonus for the template; 0 if it was never used
+    int boost(uint64_t key) const;
+
+    // Templates are identified by name and category, like TemplateDiff
+    static uint64_t keyOf(std::string_view name, std::string_view category);
+
+private:
+    bool compact();
+    bool openForAppend();
+    void addUse(uint64_t key, int64_t time);
+
+    std::string m_path;
+    QFile m_file;
+    std::unordered_map<uint64_t, std::vector<int64_t>> m_uses; // newest last
+    size_t m_retained;    // uses kept in m_uses
+    size_t m_fileRecords; // records in the file
+    int64_t m_now;        // time boosts are computed for
+};
+
+#endif // USAGELOG_H
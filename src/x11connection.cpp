@@ -0,0 +1,138 @@
+#include "x11connection.h"
+#include <QSocketNotifier>
+#include <QDebug>
+#include <algorithm>
+
+// X11 headers must be included after Qt headers
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#undef None
+#undef KeyPress
+#undef KeyRelease
+#undef FocusIn
+#undef FocusOut
+
+namespace {
+// Indexed by X11Connection::AtomName
+const char *AtomNames[] = {
+    "_NET_ACTIVE_WINDOW",
+    "CLIPBOARD",
+    "TARGETS",
+    "TIMESTAMP",
+    "UTF8_STRING",
+    "TEXT",
+    "INCR",
+    "MULTIPLE",
+    "_CLIP_TEMPLATE_TIMESTAMP",
+};
+static_assert(sizeof(AtomNames) / sizeof(AtomNames[0]) == X11Connection::AtomCount,
+              "AtomNames must list every X11Connection::AtomName");
+
+// The default handler exits the process; a target window that vanished
+// mid-paste must not take a resident instance down with it
+int logXError(Display *display, XErrorEvent *error)
+{
+    char text[256];
+    XGetErrorText(display, error->error_code, text, sizeof(text));
+    qDebug() << "[clip-template] X error:" << text << "(request" << error->request_code << ")";
+    return 0;
+}
+}
+
+X11Connection &X11Connection::instance()
+{
+    static X11Connection connection;
+    return connection;
+}
+
+X11Connection::X11Connection()
+    : m_display(XOpenDisplay(nullptr))
+    , m_controlKeycode(0)
+    , m_vKeycode(0)
+    , m_leftKeycode(0)
+    , m_notifier(nullptr)
+{
+    for (Atom &atom : m_atoms) {
+        atom = 0;
+    }
+
+    if (!m_display) {
+        return;
+    }
+
+    XSetErrorHandler(logXError);
+
+    // One round trip for all atoms
+    XInternAtoms(m_display, const_cast<char **>(AtomNames), AtomCount, False, m_atoms);
+    refreshKeycodes();
+}
+
+X11Connection::~X11Connection()
+{
+    delete m_notifier;
+    if (m_display) {
+        XCloseDisplay(m_display);
+    }
+}
+
+void X11Connection::refreshKeycodes()
+{
+    if (!m_display) {
+        return;
+    }
+
+    m_controlKeycode = XKeysymToKeycode(m_display, XK_Control_L);
+    m_vKeycode = XKeysymToKeycode(m_display, XK_v);
+    m_leftKeycode = XKeysymToKeycode(m_display, XK_Left);
+}
+
+void X11Connection::addEventHandler(X11EventHandler *handler)
+{
+    if (!m_display) {
+        return;
+    }
+
+    if (!m_notifier) {
+        m_notifier = new QSocketNotifier(ConnectionNumber(m_display), QSocketNotifier::Read);
+        QObject::connect(m_notifier, &QSocketNotifier::activated, [this]() {
+            processPendingEvents();
+        });
+    }
+
+    if (std::find(m_handlers.begin(), m_handlers.end(), handler) == m_handlers.end()) {
+        m_handlers.push_back(handler);
+    }
+}
+
+void X11Connection::removeEventHandler(X11EventHandler *handler)
+{
+    m_handlers.erase(std::remove(m_handlers.begin(), m_handlers.end(), handler), m_handlers.end());
+}
+
+void X11Connection::processPendingEvents()
+{
+    if (!m_display) {
+        return;
+    }
+
+    while (XPending(m_display) > 0) {
+        XEvent event;
+        XNextEvent(m_display, &event);
+
+        if (event.type == MappingNotify) {
+            XRefreshKeyboardMapping(&event.xmapping);
+            refreshKeycodes();
+        }
+
+        // Handlers may unregister themselves while handling an event
+        const std::vector<X11EventHandler *> handlers = m_handlers;
+        for (X11EventHandler *handler : handlers) {
+            if (std::find(m_handlers.begin(), m_handlers.end(), handler) == m_handlers.end()) {
+                continue;
+            }
+            if (handler->x11Event(&event)) {
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef X11CONNECTION_H
+#define X11CONNECTION_H
+
+#include <vector>
+
+// Forward declarations for X11 types
+typedef unsigned long XID;
+typedef XID Window;
+typedef unsigned long Atom;
+typedef unsigned char KeyCode;
+struct _XDisplay;
+typedef struct _XDisplay Display;
+union _XEvent;
+typedef union _XEvent XEvent;
+
+class QSocketNotifier;
+
+// Receives events read from the shared X connection
+class X11EventHandler {
+public:
+    virtual ~X11EventHandler() = default;
+
+    // Return true to stop the event from reaching later handlers
+    virtual bool x11Event(XEvent *event) = 0;
+};
+
+// The application's single X connection. It is opened on first use and
+// kept for the life of the process, with the atoms and keycodes the
+// paste path needs looked up once, so pasting costs no extra round trips.
+//
+// Events are read from the Qt event loop and passed to the registered
+// handlers. Xlib may queue events during any round trip, so code that
+// makes one should call processPendingEvents() afterwards.
+class X11Connection {
+public:
+    enum AtomName {
+        NetActiveWindow,
+        Clipboard,
+        Targets,
+        Timestamp,
+        Utf8String,
+        Text,
+        Incr,
+        Multiple,
+        TimestampProperty,
+        AtomCount
+    };
+
+    static X11Connection &instance();
+
+    // nullptr when no X server is reachable
+    Display *display() const { return m_display; }
+
+    Atom atom(AtomName name) const { return m_atoms[name]; }
+
+    KeyCode controlKeycode() const { return m_controlKeycode; }
+    KeyCode vKeycode() const { return m_vKeycode; }
+    KeyCode leftKeycode() const { return m_leftKeycode; }
+
+    // Look the keycodes up again after the keyboard mapping changed
+    void refreshKeycodes();
+
+    void addEventHandler(X11EventHandler *handler);
+    void removeEventHandler(X11EventHandler *handler);
+    void processPendingEvents();
+
+private:
+    X11Connection();
+    ~X11Connection();
+    X11Connection(const X11Connection &) = delete;
+    X11Connection &operator=(const X11Connection &) = delete;
+
+    Display *m_display;
+    Atom m_atoms[AtomCount];
+    KeyCode m_controlKeycode;
+    KeyCode m_vKeycode;
+    KeyCode m_leftKeycode;
+    QSocketNotifier *m_notifier;
+    std::vector<X11EventHandler *> m_handlers;
+};
+
+#endif // X11CONNECTION_H
@@ -0,0 +1,185 @@
+// Reads templates.yaml variants through ConfigReader, all at once and in
+// batches, and writes it back. Exits non-zero if any check failed.
+
+#include "configreader.h"
+#include "testutil.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+std::string writeFile(const std::string &dir, const std::string &name, const std::string &text)
+{
+    const std::string path = dir + "/" + name;
+    std::ofstream(path) << text;
+    return path;
+}
+
+// The batches readConfigStreaming delivers, joined
+bool readStreaming(const std::string &path, std::vector<Template> &templates)
+{
+    templates.clear();
+    return ConfigReader().readConfigStreaming(path, 1, [&templates](std::vector<Template> &batch) {
+        templates.insert(templates.end(), batch.begin(), batch.end());
+        return true;
+    });
+}
+
+void testAliases(const std::string &dir)
+{
+    const std::string path = writeFile(dir, "aliases.yaml",
+        "templates:\n"
+        "  - &greeting\n"
+        "    name: \"hello\"\n"
+        "    content: &text \"Hello, world\"\n"
+        "    category: \"mail\"\n"
+        "    shortcut: 1\n"
+        "  - *greeting\n"
+        "  - name: \"again\"\n"
+        "    content: *text\n");
+
+    std::vector<Template> templates;
+    check(ConfigReader().readConfig(path, templates), "read a file with aliases");
+    check(templates.size() == 3, "an alias to a template map is a template");
+    if (templates.size() == 3) {
+        check(templates[1].name == "hello" && templates[1].content == "Hello, world" &&
+              templates[1].category == "mail" && templates[1].shortcut == 1, "the alias repeats every field");
+        check(templates[2].content == "Hello, world", "an alias to a scalar is its value");
+    }
+}
+
+// As the earlier YAML::Node reader read them
+void testNulls(const std::string &dir)
+{
+    const std::string path = writeFile(dir, "nulls.yaml",
+        "templates:\n"
+        "  - name: \"tilde\"\n"
+        "    content: ~\n"
+        "  - name: \"word\"\n"
+        "    content: null\n"
+        "  - name: \"missing\"\n"
+        "    content:\n"
+        "  - name: \"quoted\"\n"
+        "    content: \"~\"\n"
+        "    shortcut: ~\n");
+
+    std::vector<Template> templates;
+    check(ConfigReader().readConfig(path, templates) && templates.size() == 4, "read a file with nulls");
+    if (templates.size() == 4) {
+        check(templates[0].content == "null" && templates[1].content == "null" && templates[2].content == "null",
+              "a null content reads as \"null\"");
+        check(templates[3].content == "~" && templates[3].shortcut == 0, "a quoted tilde is text");
+    }
+}
+
+void testParseError(const std::string &dir)
+{
+    std::string text = "templates:\n";
+    for (int i = 0; i < 100; ++i) {
+        text += "  - name: \"t" + std::to_string(i) + "\"\n    content: \"c\"\n";
+    }
+    text += "  - name: [unclosed\n";
+    const std::string path = writeFile(dir, "broken.yaml", text);
+
+    std::vector<Template> templates;
+    check(!ConfigReader().readConfig(path, templates), "a parse error fails readConfig");
+    check(templates.empty(), "readConfig keeps nothing from a broken file");
+
+    check(!readStreaming(path, templates), "a parse error fails readConfigStreaming");
+    check(templates.size() == 100, "batches before a parse error stay delivered");
+}
+
+void testMissingAndEmpty(const std::string &dir)
+{
+    std::vector<Template> templates;
+    check(!ConfigReader().readConfig(dir + "/missing.yaml", templates), "a missing file fails");
+
+    const std::string empty = writeFile(dir, "empty.yaml", "");
+    check(ConfigReader().readConfig(empty, templates) && templates.empty(), "an empty file has no templates");
+
+    const std::string other = writeFile(dir, "other.yaml", "search:\n  mode: fuzzy\n");
+    check(ConfigReader().readConfig(other, templates) && templates.empty(), "a file without templates has none");
+}
+
+void testBothAgree(const std::string &dir)
+{
+    std::string text = "templates:\n";
+    for (int i = 0; i < 1000; ++i) {
+        text += "  - name: \"t" + std::to_string(i) + "\"\n"
+                "    content: |\n      line one\n      line " + std::to_string(i) + "\n"
+                "    shortcut: \"" + std::to_string(i % 10) + "x\"\n";
+    }
+    const std::string path = writeFile(dir, "many.yaml", text);
+
+    std::vector<Template> all;
+    std::vector<Template> streamed;
+    check(ConfigReader().readConfig(path, all), "read many templates");
+    check(readStreaming(path, streamed), "stream many templates");
+    check(all.size() == 1000 && streamed.size() == all.size(), "every template is read");
+    for (size_t i = 0; i < all.size() && i < streamed.size(); ++i) {
+        if (all[i].name != streamed[i].name || all[i].content != streamed[i].content ||
+            all[i].shortcut != streamed[i].shortcut) {
+            check(false, "template " + std::to_string(i) + " differs between the readers");
+            break;
+        }
+    }
+    if (all.size() > 7) {
+        check(all[7].content == "line one\nline 7\n" && all[7].shortcut == 7, "block scalars and shortcuts");
+    }
+}
+
+void testWriteThroughSymlink(const std::string &dir)
+{
+    const std::string target = writeFile(dir, "real.yaml", "templates: []\n");
+    const std::string link = dir + "/linked.yaml";
+    ::chmod(target.c_str(), 0640);
+    check(::symlink(target.c_str(), link.c_str()) == 0, "create a symlink");
+
+    Template tmpl;
+    tmpl.name = "linked";
+    tmpl.content = "through the link";
+    check(ConfigReader().writeConfig(link, {tmpl}), "write through a symlink");
+
+    struct stat linkStat;
+    struct stat targetStat;
+    check(::lstat(link.c_str(), &linkStat) == 0 && S_ISLNK(linkStat.st_mode), "the symlink stays a symlink");
+    check(::stat(target.c_str(), &targetStat) == 0 && (targetStat.st_mode & 07777) == 0640,
+          "the target keeps its permissions");
+
+    std::vector<Template> templates;
+    check(ConfigReader().readConfig(target, templates) && templates.size() == 1 &&
+          templates[0].content == "through the link", "the target holds the new templates");
+}
+
+} // namespace
+
+int main()
+{
+    char pattern[] = "/tmp/clip-template-configreadertest-XXXXXX";
+    if (!mkdtemp(pattern)) {
+        std::cerr << "Cannot create a temporary directory" << std::endl;
+        return 1;
+    }
+    const std::string dir = pattern;
+
+    testAliases(dir);
+    testNulls(dir);
+    testParseError(dir);
+    testMissingAndEmpty(dir);
+    testBothAgree(dir);
+    testWriteThroughSymlink(dir);
+
+    for (const char *name : {"aliases.yaml", "nulls.yaml", "broken.yaml", "empty.yaml", "other.yaml", "many.yaml",
+                             "real.yaml", "linked.yaml"}) {
+        std::remove((dir + "/" + name).c_str());
+    }
+    rmdir(dir.c_str());
+
+    return testResult();
+}
@@ -0,0 +1,194 @@
+// Checks that FuzzyMatcher's SIMD prefilter picks the same candidates as
+// the scalar one, and that neither rejects a key the query matches, over
+// keys built to hit the vector loops' edges: lengths around 16 and 32
+// bytes, multibyte UTF-8, and NUL field separators, in lists whose sizes
+// leave every possible tail. Then both must rank a mixed ASCII/Japanese
+// library identically. Exits non-zero if any check failed.
+
+#include "fuzzymatcher.h"
+#include "templatestore.h"
+#include "testutil.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Pieces keys are made of; multibyte ones share lead bytes on purpose
+const std::string Pieces[] = {
+    "a", "m", "z", "0", "9", " ", "-", ".",
+    std::string(1, '\0'), // field separator
+    "\xC3\xA9",         // é
+    "\xE3\x81\x8B",     // か
+    "\xE3\x81\x8E",     // ぎ
+    "\xE3\x82\x8A",     // り
+    "\xE6\x97\xA5",     // 日
+    "\xF0\x9F\x93\x8B", // 📋
+};
+
+struct Random {
+    uint32_t state = 12345;
+    uint32_t next()
+    {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+};
+
+// A key of about length bytes; multibyte pieces may overshoot by three
+std::string makeKey(Random &random, size_t length)
+{
+    std::string key;
+    while (key.size() < length) {
+        key += Pieces[random.next() % (sizeof(Pieces) / sizeof(Pieces[0]))];
+    }
+    return key;
+}
+
+std::vector<Template> makeTemplates(size_t count)
+{
+    static const size_t Lengths[] = {0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 47, 48, 63, 64, 65, 200};
+    Random random;
+    std::vector<Template> templates;
+    for (size_t i = 0; i < count; ++i) {
+        Template tmpl;
+        tmpl.name = "t" + std::to_string(i);
+        tmpl.searchKey = makeKey(random, Lengths[i % (sizeof(Lengths) / sizeof(Lengths[0]))]);
+        templates.push_back(tmpl);
+    }
+    return templates;
+}
+
+void testQuery(const TemplateStore &store, FuzzyMatcher &simd, FuzzyMatcher &scalar, const std::string &query)
+{
+    simd.setQuery(query);
+    scalar.setQuery(query);
+    std::vector<uint32_t> simdCandidates;
+    std::vector<uint32_t> scalarCandidates;
+    simd.prefilter(simdCandidates);
+    scalar.prefilter(scalarCandidates);
+
+    const std::string where = "query \"" + query + "\" over " + std::to_string(store.size()) + " keys";
+    check(simdCandidates == scalarCandidates, "SIMD and scalar candidates differ for " + where);
+
+    for (uint32_t id = 0; id < store.size(); ++id) {
+        int score = 0;
+        if (scalar.score(store.searchKey(id), score) &&
+            !std::binary_search(scalarCandidates.begin(), scalarCandidates.end(), id)) {
+            check(false, "matching key " + std::to_string(id) + " was filtered out for " + where);
+            break;
+        }
+    }
+}
+
+// Folded keys (name, category, content) of a library mixing English and
+// Japanese, hiragana as SearchFold leaves katakana
+std::vector<Template> makeLibrary(size_t count)
+{
+    static const char *const Names[] = {
+        "meeting notes", "\xE4\xBC\x9A\xE8\xAD\xB0\xE3\x83\xA1\xE3\x83\xA2", // 会議メモ
+        "thank you mail", "\xE3\x81\x8A\xE7\xA4\xBC", // お礼
+        "weekly report", "\xE9\x80\xB1\xE5\xA0\xB1", // 週報
+        "bug report template", "\xE3\x81\xB0\xE3\x81\x90\xE5\xA0\xB1\xE5\x91\x8A", // ばぐ報告
+        "address", "\xE4\xBD\x8F\xE6\x89\x80 tokyo", // 住所 tokyo
+    };
+    static const char *const Categories[] = {
+        "mail", "\xE4\xBB\x95\xE4\xBA\x8B", "", "dev", "\xE3\x81\x82\xE3\x81\x84\xE3\x81\x95\xE3\x81\xA4",
+    };
+    static const char *const Contents[] = {
+        "hello,\nplease find the notes below.",
+        "\xE3\x81\x8A\xE4\xB8\x96\xE8\xA9\xB1\xE3\x81\xAB\xE3\x81\xAA\xE3\x81\xA3\xE3\x81\xA6\xE3\x81\x8A"
+        "\xE3\x82\x8A\xE3\x81\xBE\xE3\x81\x99", // お世話になっております
+        "steps to reproduce:\n1. \n2. \nexpected: actual:",
+        "\xE6\x9C\xAC\xE6\x97\xA5\xE3\x81\xAE\xE4\xBD\x9C\xE6\xA5\xAD mtg 10:00", // 本日の作業 mtg 10:00
+        "",
+    };
+    Random random;
+    std::vector<Template> templates;
+    for (size_t i = 0; i < count; ++i) {
+        Template tmpl;
+        tmpl.name = Names[random.next() % (sizeof(Names) / sizeof(Names[0]))] + std::string(" ") + std::to_string(i);
+        tmpl.searchKey = tmpl.name + '\0' + Categories[random.next() % (sizeof(Categories) / sizeof(Categories[0]))] +
+                         '\0' + Contents[random.next() % (sizeof(Contents) / sizeof(Contents[0]))];
+        templates.push_back(tmpl);
+    }
+    return templates;
+}
+
+// The best matches as TemplateSearch ranks them: prefilter, score, rank
+std::vector<FuzzyMatcher::Match> ranked(const TemplateStore &store, const FuzzyMatcher &matcher, size_t limit)
+{
+    std::vector<uint32_t> candidates;
+    matcher.prefilter(candidates);
+    std::vector<FuzzyMatcher::Match> matches;
+    for (uint32_t id : candidates) {
+        int score = 0;
+        if (matcher.score(store.searchKey(id), score)) {
+            matches.push_back({id, score});
+        }
+    }
+    FuzzyMatcher::rank(matches, limit);
+    return matches;
+}
+
+void testRanking()
+{
+    static const char *const Queries[] = {
+        "m", "mtg", "report", "rep 1", "\xE3\x81\x8A", "\xE4\xBC\x9A\xE8\xAD\xB0", "\xE5\xA0\xB1",
+        "\xE3\x81\x8A\xE4\xB8\x96\xE8\xA9\xB1", "tokyo", "\xE4\xBD\x8F tk", "mail 3", "\xE4\xBD\x9Cmtg",
+    };
+
+    TemplateStore store;
+    store.assign(makeLibrary(5003));
+    FuzzyMatcher simd;
+    FuzzyMatcher scalar;
+    simd.setTemplates(store);
+    scalar.setTemplates(store);
+    scalar.setSimdEnabled(false);
+
+    for (const char *query : Queries) {
+        simd.setQuery(query);
+        scalar.setQuery(query);
+        for (size_t limit : {size_t(1), size_t(50), size_t(100000)}) {
+            const std::vector<FuzzyMatcher::Match> simdRanked = ranked(store, simd, limit);
+            const std::vector<FuzzyMatcher::Match> scalarRanked = ranked(store, scalar, limit);
+            const std::string where = std::string("query \"") + query + "\", limit " + std::to_string(limit);
+            check(!scalarRanked.empty(), "the library matches " + where);
+            bool same = simdRanked.size() == scalarRanked.size();
+            for (size_t i = 0; same && i < simdRanked.size(); ++i) {
+                same = simdRanked[i].id == scalarRanked[i].id && simdRanked[i].score == scalarRanked[i].score;
+            }
+            check(same, "SIMD and scalar rankings differ for " + where);
+        }
+    }
+}
+
+} // namespace
+
+int main()
+{
+    static const char *const Queries[] = {
+        "", "a", "am", "z9", "0-.", "m a", "\xC3\xA9", "\xE3\x81\x8B\xE3\x81\x8E", "\xE3\x82\x8A\xE6\x97\xA5",
+        "a\xE3\x81\x8B" "9", "\xF0\x9F\x93\x8B", "zzzzzzzz", "q",
+    };
+
+    // Every remainder modulo the two- and four-key vector widths
+    for (size_t count : {0, 1, 2, 3, 4, 5, 6, 7, 61, 62, 63, 64, 1021}) {
+        TemplateStore store;
+        store.assign(makeTemplates(count));
+        FuzzyMatcher simd;
+        FuzzyMatcher scalar;
+        simd.setTemplates(store);
+        scalar.setTemplates(store);
+        scalar.setSimdEnabled(false);
+        for (const char *query : Queries) {
+            testQuery(store, simd, scalar, query);
+        }
+    }
+
+    testRanking();
+
+    return testResult();
+}
@@ -0,0 +1,216 @@
+// Pastes through a built clip-template on a private Xvfb and checks the
+// bytes that arrive in the target window (see x11harness.h).
+//
+// Usage: clip-template-pastetest MODE path/to/clip-template
+//   --incr   a 50 MB template, served by SelectionOwner over INCR
+//   --type   2 KB typed by KeyTyper, including characters it has to map
+//            onto spare keys, which must be unmapped again by the time
+//            the popup has exited
+//
+// Exits with 77, which CTest counts as skipped, where Xvfb cannot be
+// started.
+
+#include "x11harness.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XTest.h>
+
+using namespace x11harness;
+
+namespace {
+
+const size_t IncrSize = 50 * 1024 * 1024;
+const size_t TypedSize = 2048;
+const int PopupTimeout = 30000;
+const int PasteTimeout = 120000;
+const int TypingTimeout = 30000;
+const int ExitTimeout = 5000;
+
+// Varied enough that a lost, repeated or reordered chunk changes it,
+// and free of YAML escapes and placeholders
+std::string incrText()
+{
+    static const char Alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789 .,-";
+    std::string text(IncrSize, ' ');
+    uint32_t state = 1;
+    for (char &c : text) {
+        state = state * 1664525u + 1013904223u;
+        c = Alphabet[(state >> 24) % (sizeof(Alphabet) - 1)];
+    }
+    return text;
+}
+
+// Both shift levels, tabs and line breaks, and at the end characters no
+// key carries, so the spare keys are still mapped when typing finishes
+std::string typedText()
+{
+    static const char Line[] = "The quick brown fox jumps over the lazy dog. 0123456789\t!@#$%^&*()_+-=[];':\",./<>?|\\~`\n";
+    std::string text;
+    while (text.size() + sizeof(Line) < TypedSize - 32) {
+        text += Line;
+    }
+    text += "\u3042\u3044\u3046\u3048\u304a caf\u00e9 \u00f1and\u00fa \u2192 \u65e5\u672c\u8a9e";
+    return text;
+}
+
+std::vector<KeySym> keyboardMapping(Display *display)
+{
+    int minKeycode = 0;
+    int maxKeycode = 0;
+    XDisplayKeycodes(display, &minKeycode, &maxKeycode);
+    int perKeycode = 0;
+    KeySym *keysyms = XGetKeyboardMapping(display, static_cast<KeyCode>(minKeycode),
+                                          maxKeycode - minKeycode + 1, &perKeycode);
+    std::vector<KeySym> mapping;
+    if (keysyms) {
+        mapping.assign(keysyms, keysyms + (maxKeycode - minKeycode + 1) * perKeycode);
+        XFree(keysyms);
+    }
+    return mapping;
+}
+
+// Index of the first differing byte, for the failure message
+size_t mismatchAt(const std::string &expected, const std::string &actual)
+{
+    const size_t size = std::min(expected.size(), actual.size());
+    for (size_t i = 0; i < size; ++i) {
+        if (expected[i] != actual[i]) {
+            return i;
+        }
+    }
+    return size;
+}
+
+int runIncr(Display *display, const std::string &program)
+{
+    const std::string expected = incrText();
+    // Nothing is restored afterwards, and the transfer may take longer
+    // than the default wait for it
+    const std::string home = prepareHome(std::string("templates:\n") +
+                                         "  - name: \"incr\"\n" +
+                                         "    content: " + yamlQuoted(expected) + "\n" +
+                                         "    category: \"test\"\n",
+                                         "paste:\n"
+                                         "  transfer_timeout_ms: " + std::to_string(PasteTimeout) + "\n");
+    if (home.empty()) {
+        std::cerr << "cannot create a temporary HOME" << std::endl;
+        return 1;
+    }
+
+    int result = 1;
+    {
+        Target target(display);
+        target.focus();
+        const pid_t popup = spawn({program}, homeEnvironment(home));
+
+        std::string text;
+        Clock::time_point pasted;
+        if (!target.waitForFocusOut(PopupTimeout)) {
+            std::cerr << "the popup never took the focus" << std::endl;
+        } else {
+            target.pressReturn();
+            if (!target.waitForPaste(PasteTimeout, pasted, text)) {
+                std::cerr << "no paste arrived; received " << text.size() << " bytes" << std::endl;
+            } else if (text != expected) {
+                std::cerr << "received " << text.size() << " of " << expected.size()
+                          << " bytes, first difference at " << mismatchAt(expected, text) << std::endl;
+            } else {
+                std::cerr << "received all " << text.size() << " bytes in "
+                          << elapsedMs(pasted, Clock::now()) << " ms" << std::endl;
+                result = 0;
+            }
+        }
+        stop(popup);
+    }
+    removeHome(home);
+    return result;
+}
+
+int runType(Display *display, const std::string &program)
+{
+    const std::string expected = typedText();
+    const std::string home = prepareHome(std::string("templates:\n") +
+                                         "  - name: \"type\"\n" +
+                                         "    content: " + yamlQuoted(expected) + "\n" +
+                                         "    category: \"test\"\n",
+                                         "paste:\n"
+                                         "  mode: \"type\"\n");
+    if (home.empty()) {
+        std::cerr << "cannot create a temporary HOME" << std::endl;
+        return 1;
+    }
+
+    int result = 1;
+    {
+        Target target(display);
+        target.focus();
+        const std::vector<KeySym> mapping = keyboardMapping(display);
+        const pid_t popup = spawn({program}, homeEnvironment(home));
+
+        std::string text;
+        if (!target.waitForFocusOut(PopupTimeout)) {
+            std::cerr << "the popup never took the focus" << std::endl;
+            stop(popup);
+        } else {
+            target.pressReturn();
+            const bool typed = target.waitForTyping(expected.size(), TypingTimeout, text);
+            // The popup quits by itself once the keymap is restored
+            const bool exited = waitForExit(popup, ExitTimeout);
+            if (!exited) {
+                stop(popup);
+            }
+
+            if (!typed) {
+                std::cerr << "received " << text.size() << " of " << expected.size() << " bytes" << std::endl;
+            } else if (text != expected) {
+                std::cerr << "typed text differs at byte " << mismatchAt(expected, text) << std::endl;
+            } else if (!exited) {
+                std::cerr << "the popup did not exit after typing" << std::endl;
+            } else if (keyboardMapping(display) != mapping) {
+                std::cerr << "the spare keys were left mapped" << std::endl;
+            } else {
+                std::cerr << "typed all " << text.size() << " bytes" << std::endl;
+                result = 0;
+            }
+        }
+    }
+    removeHome(home);
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    const bool incr = argc == 3 && std::strcmp(argv[1], "--incr") == 0;
+    const bool type = argc == 3 && std::strcmp(argv[1], "--type") == 0;
+    if (!incr && !type) {
+        std::cerr << "usage: clip-template-pastetest --incr|--type path/to/clip-template" << std::endl;
+        return 2;
+    }
+
+    const pid_t xvfb = startXvfb();
+    if (xvfb < 0) {
+        std::cerr << "cannot start Xvfb" << std::endl;
+        return SkipExitCode;
+    }
+    Display *display = XOpenDisplay(nullptr);
+    int eventBase, errorBase, major, minor;
+    if (!display || !XTestQueryExtension(display, &eventBase, &errorBase, &major, &minor)) {
+        std::cerr << "no X display with the XTEST extension" << std::endl;
+        stop(xvfb);
+        return SkipExitCode;
+    }
+
+    const int result = incr ? runIncr(display, argv[2]) : runType(display, argv[2]);
+
+    XCloseDisplay(display);
+    stop(xvfb);
+    return result;
+}
@@ -0,0 +1,167 @@
+// Replays TemplateJournal files after the crashes it has to survive.
+// Exits non-zero if any check failed.
+
+#include "templatejournal.h"
+#include "configreader.h"
+#include "testutil.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <iostream>
+
+namespace {
+
+Template makeTemplate(const std::string &name, const std::string &content)
+{
+    Template tmpl;
+    tmpl.name = name;
+    tmpl.content = content;
+    tmpl.category = "test";
+    return tmpl;
+}
+
+bool contains(const std::vector<Template> &templates, const std::string &name)
+{
+    for (const Template &tmpl : templates) {
+        if (tmpl.name == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A crash mid-append leaves part of a record; the next process must not
+// write its records behind it
+void testAppendAfterTornRecord(const QString &dir)
+{
+    const std::string yaml = (dir + "/torn.yaml").toStdString();
+    {
+        TemplateJournal journal(yaml);
+        check(journal.appendPut(makeTemplate("first", "kept")), "append first");
+        check(journal.appendPut(makeTemplate("second", "torn")), "append second");
+    }
+
+    const QString path = QString::fromStdString(TemplateJournal(yaml).path());
+    const qint64 size = QFileInfo(path).size();
+    check(QFile::resize(path, size - 5), "tear the last record");
+
+    TemplateJournal journal(yaml);
+    check(journal.appendPut(makeTemplate("third", "after the tear")), "append after the tear");
+
+    std::vector<Template> templates;
+    check(journal.replay(templates), "replay after the tear");
+    check(contains(templates, "first"), "record before the tear survives");
+    check(!contains(templates, "second"), "torn record is dropped");
+    check(contains(templates, "third"), "record appended after the tear is replayed");
+    check(templates.size() == 2, "nothing else is replayed");
+}
+
+// Even the magic can be torn, when the first append crashed
+void testAppendAfterTornMagic(const QString &dir)
+{
+    const std::string yaml = (dir + "/magic.yaml").toStdString();
+    const QString path = QString::fromStdString(TemplateJournal(yaml).path());
+    {
+        QFile file(path);
+        check(file.open(QIODevice::WriteOnly) && file.write("CLPT", 4) == 4, "write a torn magic");
+    }
+
+    TemplateJournal journal(yaml);
+    check(journal.appendPut(makeTemplate("only", "content")), "append after a torn magic");
+
+    std::vector<Template> templates;
+    check(journal.replay(templates), "replay after a torn magic");
+    check(templates.size() == 1 && contains(templates, "only"), "the new record is replayed");
+}
+
+// A journal left intact is appended to, not cut
+void testAppendToIntactJournal(const QString &dir)
+{
+    const std::string yaml = (dir + "/intact.yaml").toStdString();
+    {
+        TemplateJournal journal(yaml);
+        check(journal.appendPut(makeTemplate("a", "1")), "append a");
+        check(journal.appendRemove("a", "test"), "remove a");
+    }
+
+    TemplateJournal journal(yaml);
+    check(journal.appendPut(makeTemplate("b", "2")), "append b");
+
+    std::vector<Template> templates;
+    templates.push_back(makeTemplate("a", "from the yaml"));
+    check(journal.replay(templates), "replay an intact journal");
+    check(!contains(templates, "a") && contains(templates, "b"), "every record is replayed");
+}
+
+// Compaction writes the merged YAML and then deletes the aside journal;
+// a crash between the two makes the next load apply those edits again
+void testCrashBetweenWriteAndDelete(const QString &dir)
+{
+    const std::string yaml = (dir + "/compact.yaml").toStdString();
+    Template kept = makeTemplate("kept", "from the yaml");
+    Template edited = makeTemplate("edited", "old");
+    Template removed = makeTemplate("removed", "gone");
+    ConfigReader reader;
+    check(reader.writeConfig(yaml, {kept, edited, removed}), "write the yaml");
+
+    {
+        TemplateJournal journal(yaml);
+        check(journal.appendPut(makeTemplate("edited", "new")), "journal an update");
+        check(journal.appendPut(makeTemplate("added", "new template")), "journal an add");
+        check(journal.appendRemove("removed", "test"), "journal a remove");
+        check(journal.appendPut(makeTemplate("added", "added twice")), "journal a second put");
+
+        // TemplateManager::compactJournal, up to the crash
+        check(journal.beginCompaction(), "begin compaction");
+        std::vector<Template> templates;
+        check(reader.readConfig(yaml, templates), "read the yaml to compact");
+        check(journal.replayCompaction(templates), "replay the aside journal");
+        check(reader.writeConfig(yaml, templates), "write the merged yaml");
+    }
+
+    // The next load: the merged YAML, then the aside journal once more
+    TemplateJournal journal(yaml);
+    std::vector<Template> templates;
+    check(reader.readConfig(yaml, templates), "read the merged yaml");
+    check(journal.replay(templates), "the aside journal is still there");
+
+    check(templates.size() == 3, "replaying again adds no duplicates");
+    check(contains(templates, "kept") && contains(templates, "edited") && contains(templates, "added") &&
+          !contains(templates, "removed"), "replaying again gives the same templates");
+    for (const Template &tmpl : templates) {
+        if (tmpl.name == "edited") {
+            check(tmpl.content == "new", "the update survives");
+        } else if (tmpl.name == "added") {
+            check(tmpl.content == "added twice", "the last put wins");
+        }
+    }
+
+    // And the interrupted compaction completes
+    check(journal.beginCompaction(), "resume the compaction");
+    std::vector<Template> compacted;
+    check(reader.readConfig(yaml, compacted) && journal.replayCompaction(compacted), "replay it into the yaml");
+    check(reader.writeConfig(yaml, compacted), "write it again");
+    journal.finishCompaction();
+    check(journal.isEmpty(), "no journal is left");
+    std::vector<Template> rewritten;
+    check(reader.readConfig(yaml, rewritten) && rewritten.size() == 3 && !journal.replay(rewritten),
+          "the yaml alone holds the result");
+}
+
+} // namespace
+
+int main()
+{
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        std::cerr << "Cannot create a temporary directory" << std::endl;
+        return 1;
+    }
+
+    testAppendAfterTornRecord(dir.path());
+    testAppendAfterTornMagic(dir.path());
+    testAppendToIntactJournal(dir.path());
+    testCrashBetweenWriteAndDelete(dir.path());
+
+    return testResult();
+}
@@ -0,0 +1,41 @@
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+// Shared by the test executables here: check() reports a failed
+// condition and counts it, and main() ends with `return testResult();`,
+// which is nonzero after any failure.
+
+#include <iostream>
+#include <string>
+
+namespace testutil {
+
+inline int &failures()
+{
+    static int count = 0;
+    return count;
+}
+
+inline void check(bool condition, const std::string &what)
+{
+    if (!condition) {
+        std::cerr << "FAIL: " << what << std::endl;
+        ++failures();
+    }
+}
+
+inline int testResult()
+{
+    if (failures()) {
+        std::cerr << failures() << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace testutil
+
+using testutil::check;
+using testutil::testResult;
+
+#endif // TESTUTIL_H